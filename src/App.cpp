@@ -12,8 +12,14 @@
 // GNU General Public License for more details.
 //
 
+#ifdef __linux__
+#include <unistd.h>
+#else
 #include <direct.h>
+#endif
 #include <stdio.h>
+#include <limits.h>
+#include <errno.h>
 #include "App.h"
 #include "Platform.h"
 #include "HTTP.h"
@@ -58,6 +64,7 @@ void App::Run(int argc, char* argv[])
 	config.useSwap = false;
 	config.useEMS = true;
 	config.useXMS = true;
+	config.useScrollCache = true;
 
 	if (argc > 1)
 	{
@@ -92,6 +99,10 @@ void App::Run(int argc, char* argv[])
 			{
 				config.useXMS = false;
 			}
+			else if (!stricmp(argv[n], "-noscrollcache"))
+			{
+				config.useScrollCache = false;
+			}
 		}
 	}
 
@@ -76,6 +76,7 @@ struct AppConfig
 	bool useSwap : 1;
 	bool useEMS : 1;
 	bool useXMS : 1;
+	bool useScrollCache : 1;
 };
 
 class App
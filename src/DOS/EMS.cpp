@@ -110,6 +110,19 @@ MemBlockHandle EMSManager::Allocate(size_t size)
     return result;
 }
 
+// Only the most recent allocation can change size, and it must stay within its page
+bool EMSManager::Resize(MemBlockHandle& handle, size_t oldSize, size_t newSize)
+{
+    if (handle.type == MemBlockHandle::EMS && handle.emsPage == allocationPageIndex
+        && handle.emsPageOffset + oldSize == allocationPageUsed && handle.emsPageOffset + newSize <= EMS_PAGE_SIZE)
+    {
+        allocationPageUsed = handle.emsPageOffset + newSize;
+        return true;
+    }
+
+    return false;
+}
+
 void* EMSManager::MapBlock(MemBlockHandle& handle)
 {
     if (isAvailable && handle.type == MemBlockHandle::EMS)
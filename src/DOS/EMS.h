@@ -19,6 +19,7 @@ public:
 	bool IsAvailable() { return isAvailable; }
 
 	MemBlockHandle Allocate(size_t size);
+	bool Resize(MemBlockHandle& handle, size_t oldSize, size_t newSize);
 	void* MapBlock(MemBlockHandle& handle);
 
 	void Shutdown();
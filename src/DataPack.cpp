@@ -58,12 +58,12 @@ bool DataPack::Load(const char* path)
 	radioSelected = LoadImageAsset(fs, header, "IRADIO2");
 	downIcon = LoadImageAsset(fs, header, "IDOWN");
 
-	fonts[0] = (Font*)LoadAsset(fs, header, "FHELV1");
-	fonts[1] = (Font*)LoadAsset(fs, header, "FHELV2");
-	fonts[2] = (Font*)LoadAsset(fs, header, "FHELV3");
-	monoFonts[0] = (Font*)LoadAsset(fs, header, "FCOUR1");
-	monoFonts[1] = (Font*)LoadAsset(fs, header, "FCOUR2");
-	monoFonts[2] = (Font*)LoadAsset(fs, header, "FCOUR3");
+	fonts[0] = LoadFontAsset(fs, header, "FHELV1");
+	fonts[1] = LoadFontAsset(fs, header, "FHELV2");
+	fonts[2] = LoadFontAsset(fs, header, "FHELV3");
+	monoFonts[0] = LoadFontAsset(fs, header, "FCOUR1");
+	monoFonts[1] = LoadFontAsset(fs, header, "FCOUR2");
+	monoFonts[2] = LoadFontAsset(fs, header, "FCOUR3");
 
 	delete[] header.entries;
 	fclose(fs);
@@ -140,7 +140,18 @@ Image* DataPack::LoadImageAsset(FILE* fs, DataPackHeader& header, const char* en
 	return nullptr;
 }
 
-void* DataPack::LoadAsset(FILE* fs, DataPackHeader& header, const char* entryName, void* buffer)
+Font* DataPack::LoadFontAsset(FILE* fs, DataPackHeader& header, const char* entryName)
+{
+	// Leave space in front of the font data for the width table
+	Font* font = (Font*)LoadAsset(fs, header, entryName, NULL, FONT_DATA_OFFSET);
+	if (font)
+	{
+		font->BuildGlyphWidthTable();
+	}
+	return font;
+}
+
+void* DataPack::LoadAsset(FILE* fs, DataPackHeader& header, const char* entryName, void* buffer, size_t reserveSize)
 {
 	DataPackEntry* entry = NULL;
 
@@ -163,14 +174,14 @@ void* DataPack::LoadAsset(FILE* fs, DataPackHeader& header, const char* entryNam
 
 	if (!buffer)
 	{
-		buffer = malloc(length);
+		buffer = malloc(reserveSize + length);
 	}
 	if (!buffer)
 	{
 		Platform::FatalError("Could not allocate memory for data pack asset %s", entryName);
 	}
 
-	fread(buffer, length, 1, fs);
+	fread((uint8_t*)buffer + reserveSize, length, 1, fs);
 
 	return buffer;
 }
@@ -77,11 +77,13 @@ struct DataPack
 
 	bool LoadPreset(Preset preset);
 	bool Load(const char* path);
+	static const char* GetPresetFilename(Preset preset) { return datapackFilenames[preset]; }
 	Font* GetFont(int fontSize, FontStyle::Type fontStyle);
 	MouseCursorData* GetMouseCursorData(MouseCursor::Type type);
 
 private:
-	void* LoadAsset(FILE* fs, DataPackHeader& header, const char* entryName, void* buffer = NULL);
+	void* LoadAsset(FILE* fs, DataPackHeader& header, const char* entryName, void* buffer = NULL, size_t reserveSize = 0);
+	Font* LoadFontAsset(FILE* fs, DataPackHeader& header, const char* entryName);
 	Image* LoadImageAsset(FILE* fs, DataPackHeader& header, const char* entryName);
 	int FontSizeToIndex(int fontSize);
 	static const char* datapackFilenames[];
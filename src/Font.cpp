@@ -12,47 +12,144 @@
 // GNU General Public License for more details.
 //
 
+#include <string.h>
 #include "Font.h"
 
-int Font::CalculateWidth(const char* text, FontStyle::Type style)
+void Font::BuildGlyphWidthTable()
 {
-	int result = 0;
-
-	uint8_t bold = (style & FontStyle::Bold) ? 1 : 0;
-
-	while (*text)
+	for (int n = 0; n < 256; n++)
 	{
-		char c = *text++;
+		int index = n - FIRST_FONT_GLYPH;
+		glyphWidths[n] = index < 0 ? 0 : glyphs[index].width;
+	}
+}
 
-		int index = (unsigned char)c - FIRST_FONT_GLYPH;
-		if (index < 0)
-		{
-			continue;
-		}
+// Bold text is rare enough that it doesn't get its own table, each glyph is one pixel wider
+int Font::CalculateBoldWidth(const char* text, int length)
+{
+	const uint8_t* p = (const uint8_t*) text;
+	int result = 0;
 
-		uint8_t width = glyphs[index].width;
+	while (length--)
+	{
+		uint8_t width = glyphWidths[*p++];
 		if (width)
 		{
-			result += width + bold;
+			result += width + 1;
 		}
 	}
 
 	return result;
 }
 
-int Font::GetGlyphWidth(char c, FontStyle::Type style)
+int Font::CalculateWidth(const char* text, FontStyle::Type style)
 {
-	int index = (unsigned char)(c)-FIRST_FONT_GLYPH;
-	if (index < 0)
+	if (style & FontStyle::Bold)
 	{
-		return 0;
+		return CalculateBoldWidth(text, strlen(text));
 	}
-	int result = glyphs[index].width;
 
-	if (result)
+	const uint8_t* widths = glyphWidths;
+	const uint8_t* p = (const uint8_t*) text;
+	int result = 0;
+
+	for (;;)
 	{
-		if (style & FontStyle::Bold)
-			result++;
+		if (!p[0])
+			break;
+		result += widths[p[0]];
+		if (!p[1])
+			break;
+		result += widths[p[1]];
+		if (!p[2])
+			break;
+		result += widths[p[2]];
+		if (!p[3])
+			break;
+		result += widths[p[3]];
+		p += 4;
 	}
+
 	return result;
 }
+
+// Measures the first length characters of text, which doesn't need to be null terminated
+int Font::CalculateWidth(const char* text, int length, FontStyle::Type style)
+{
+	if (style & FontStyle::Bold)
+	{
+		return CalculateBoldWidth(text, length);
+	}
+
+	const uint8_t* widths = glyphWidths;
+	const uint8_t* p = (const uint8_t*) text;
+	int result = 0;
+
+	while (length >= 4)
+	{
+		result += widths[p[0]] + widths[p[1]] + widths[p[2]] + widths[p[3]];
+		p += 4;
+		length -= 4;
+	}
+	while (length--)
+	{
+		result += widths[*p++];
+	}
+
+	return result;
+}
+
+// Splits text into word runs and measures up to maxRuns of them in a single pass, returning how
+// many were measured. Non breaking spaces are part of a run and are measured as spaces
+int Font::CalculateWordWidths(const char* text, TextWordRun* runs, int maxRuns, FontStyle::Type style)
+{
+	const uint8_t* p = (const uint8_t*) text;
+	int bold = (style & FontStyle::Bold) ? 1 : 0;
+	int spaceWidth = GetGlyphWidth(' ', style);
+	int numRuns = 0;
+
+	while (numRuns < maxRuns)
+	{
+		int length = 0;
+		int width = 0;
+
+		for (;;)
+		{
+			uint8_t c = p[length];
+			if (!c || c == ' ' || c == '\t' || length == MAX_TEXT_WORD_RUN_LENGTH)
+			{
+				break;
+			}
+			if (c == '\x1f')
+			{
+				width += spaceWidth;
+			}
+			else
+			{
+				uint8_t glyphWidth = glyphWidths[c];
+				if (glyphWidth)
+				{
+					width += glyphWidth + bold;
+				}
+			}
+			length++;
+		}
+
+		runs[numRuns].length = (uint8_t) length;
+		runs[numRuns].width = (uint16_t) width;
+		numRuns++;
+
+		p += length;
+		if (!*p)
+		{
+			break;
+		}
+		if (length != MAX_TEXT_WORD_RUN_LENGTH)
+		{
+			// Skip the break character
+			p++;
+		}
+	}
+
+	return numRuns;
+}
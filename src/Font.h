@@ -16,6 +16,7 @@
 #define _FONT_H_
 
 #include <stdint.h>
+#include <stddef.h>
 
 #define FIRST_FONT_GLYPH 32
 #define LAST_FONT_GLYPH 255
@@ -33,8 +34,25 @@ struct FontStyle
 	};
 };
 
+// A run of characters that can't be broken, followed by a space or tab that can be broken at.
+// Runs longer than MAX_TEXT_WORD_RUN_LENGTH characters are split and have no break character
+#pragma pack(push, 1)
+struct TextWordRun
+{
+	uint16_t width;
+	uint8_t length;
+};
+#pragma pack(pop)
+
+#define MAX_TEXT_WORD_RUN_LENGTH 255
+
 struct Font 
 {
+	// Width of every character code for regular text, zero where there is no glyph. Bold glyphs
+	// are one pixel wider. Built by BuildGlyphWidthTable when the font is loaded, in front of the
+	// data pack contents
+	uint8_t glyphWidths[256];
+
 #pragma pack(push, 1)
 	struct Glyph
 	{
@@ -49,8 +67,25 @@ struct Font
 	uint8_t glyphHeight;
 	uint8_t glyphData[1];
 
+	void BuildGlyphWidthTable();
+
+	int GetGlyphWidth(char c, FontStyle::Type style = FontStyle::Regular)
+	{
+		int width = glyphWidths[(unsigned char)c];
+		if (width && (style & FontStyle::Bold))
+			width++;
+		return width;
+	}
+
 	int CalculateWidth(const char* text, FontStyle::Type style = FontStyle::Regular);
-	int GetGlyphWidth(char c, FontStyle::Type style = FontStyle::Regular);
+	int CalculateWidth(const char* text, int length, FontStyle::Type style = FontStyle::Regular);
+	int CalculateWordWidths(const char* text, TextWordRun* runs, int maxRuns, FontStyle::Type style = FontStyle::Regular);
+
+private:
+	int CalculateBoldWidth(const char* text, int length);
 };
 
+// Offset of the data pack contents within a loaded font
+#define FONT_DATA_OFFSET offsetof(Font, glyphs)
+
 #endif
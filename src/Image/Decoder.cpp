@@ -12,7 +12,6 @@
 #pragma warning(disable:4996)
 
 #include <stdio.h>
-#include <conio.h>
 
 typedef union 
 {
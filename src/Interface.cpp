@@ -39,6 +39,9 @@ AppInterface::AppInterface(App& inApp) : app(inApp)
 	focusedNode = nullptr;
 	jumpTagName = nullptr;
 	jumpNode = nullptr;
+
+	firstFocusCandidateBlock = focusCandidateBlock = nullptr;
+	focusCandidateIndex = 0;
 }
 
 void AppInterface::Init()
@@ -70,6 +73,10 @@ void AppInterface::Reset()
 	jumpTagName = nullptr;
 	jumpNode = nullptr;
 
+	// Storage belongs to the page allocator, which is reset along with the page
+	firstFocusCandidateBlock = focusCandidateBlock = nullptr;
+	focusCandidateIndex = 0;
+
 	ClearStatusMessage(StatusBarNode::HoverStatus);
 	ClearStatusMessage(StatusBarNode::GeneralStatus);
 	UpdatePageScrollBar();
@@ -362,8 +369,17 @@ Node* AppInterface::PickNode(int x, int y)
 	{
 		TransformScreenToPage(x, y);
 
-		Node* pageRootNode = app.page.GetRootNode();
-		return pageRootNode->Handler().Pick(pageRootNode, x, y);
+		// The focused node can reach outside of its own area, such as an open drop down menu
+		if (focusedNode && !IsInterfaceNode(focusedNode))
+		{
+			Node* result = focusedNode->Handler().Pick(focusedNode, x, y);
+			if (result)
+			{
+				return result;
+			}
+		}
+
+		return app.pageRenderer.PickNode(x, y);
 	}
 
 	return nullptr;
@@ -675,20 +691,14 @@ void AppInterface::CycleNodes(int direction)
 				}
 				else
 				{
-					node = node->GetPreviousInTree();
+					node = FindPreviousFocusCandidate(node, isFocusedNodeVisible);
 				}
 
-				if (node && node->Handler().CanPick(node))
+				if (node && IsFocusCandidate(node, isFocusedNodeVisible))
 				{
 					Rect nodeRect;
 					node->CalculateEncapsulatingRect(nodeRect);
 
-					if (!isFocusedNodeVisible && (nodeRect.y + nodeRect.height < scrollPositionY || nodeRect.y > scrollPositionY + windowRect.height))
-					{
-						// Not visible on page and we haven't selected anything yet, try find something else to focus on
-						continue;
-					}
-
 					if (nodeRect.y < scrollPositionY)
 					{
 						ScrollAbsolute(nodeRect.y);
@@ -708,6 +718,145 @@ void AppInterface::CycleNodes(int direction)
 	FocusNode(nullptr);
 }
 
+bool AppInterface::IsFocusCandidate(Node* node, bool isFocusedNodeVisible)
+{
+	if (!node->Handler().CanPick(node))
+	{
+		return false;
+	}
+
+	if (!isFocusedNodeVisible)
+	{
+		// Nothing has been selected yet so only focus on something that is visible on the page
+		Rect nodeRect;
+		node->CalculateEncapsulatingRect(nodeRect);
+
+		if (nodeRect.y + nodeRect.height < scrollPositionY || nodeRect.y > scrollPositionY + windowRect.height)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Finds the last candidate that comes before the start node in document order
+Node* AppInterface::FindPreviousFocusCandidate(Node* start, bool isFocusedNodeVisible)
+{
+	if (start == app.page.GetRootNode())
+	{
+		return nullptr;
+	}
+
+	if (BuildFocusCandidates() && FindFocusCandidate(start))
+	{
+		if (focusCandidateIndex > 0)
+		{
+			focusCandidateIndex--;
+		}
+		else if (focusCandidateBlock->prev)
+		{
+			focusCandidateBlock = focusCandidateBlock->prev;
+			focusCandidateIndex = focusCandidateBlock->count - 1;
+		}
+		else
+		{
+			return nullptr;
+		}
+
+		return focusCandidateBlock->nodes[focusCandidateIndex].Get();
+	}
+
+	// Layout hasn't finished, or the start node isn't a candidate. Walk forwards from the top
+	// because stepping backwards from a node has to rescan its parent's children
+	Node* candidate = nullptr;
+
+	for (Node* node = app.page.GetRootNode(); node && node != start; node = node->GetNextInTree())
+	{
+		if (IsFocusCandidate(node, isFocusedNodeVisible))
+		{
+			candidate = node;
+		}
+	}
+
+	return candidate;
+}
+
+bool AppInterface::BuildFocusCandidates()
+{
+	if (firstFocusCandidateBlock)
+	{
+		return true;
+	}
+	if (!app.page.layout.IsFinished())
+	{
+		return false;
+	}
+
+	FocusCandidateBlock* block = nullptr;
+
+	for (Node* node = app.page.GetRootNode(); node; node = node->GetNextInTree())
+	{
+		if (!node->Handler().CanPick(node))
+		{
+			continue;
+		}
+
+		if (!block || block->count == FOCUS_CANDIDATES_PER_BLOCK)
+		{
+			FocusCandidateBlock* newBlock = MemoryManager::pageAllocator.Alloc<FocusCandidateBlock>();
+			if (!newBlock)
+			{
+				firstFocusCandidateBlock = nullptr;
+				return false;
+			}
+			newBlock->prev = block;
+			newBlock->next = nullptr;
+			newBlock->count = 0;
+
+			if (block)
+			{
+				block->next = newBlock;
+			}
+			else
+			{
+				firstFocusCandidateBlock = newBlock;
+			}
+			block = newBlock;
+		}
+
+		block->nodes[block->count++] = node;
+	}
+
+	focusCandidateBlock = nullptr;
+	return firstFocusCandidateBlock != nullptr;
+}
+
+// Points the focus candidate position at the node. This is normally where the last step left
+// it, otherwise (e.g. focus was given by clicking) the candidates are searched
+bool AppInterface::FindFocusCandidate(Node* node)
+{
+	if (focusCandidateBlock && focusCandidateBlock->nodes[focusCandidateIndex] == node)
+	{
+		return true;
+	}
+
+	for (FocusCandidateBlock* block = firstFocusCandidateBlock; block; block = block->next)
+	{
+		for (int n = 0; n < block->count; n++)
+		{
+			if (block->nodes[n] == node)
+			{
+				focusCandidateBlock = block;
+				focusCandidateIndex = n;
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
 void AppInterface::OnScrollBarMoved(Node* node)
 {
 	ScrollBarNode::Data* data = static_cast<ScrollBarNode::Data*>(node);
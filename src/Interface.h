@@ -22,6 +22,16 @@
 #include "Nodes/Scroll.h"
 
 #define MAX_TITLE_LENGTH 80
+#define FOCUS_CANDIDATES_PER_BLOCK 32
+
+// Nodes that can take focus, in document order
+struct FocusCandidateBlock
+{
+	FocusCandidateBlock* prev;
+	FocusCandidateBlock* next;
+	int count;
+	NodePtr nodes[FOCUS_CANDIDATES_PER_BLOCK];
+};
 
 class App;
 class Node;
@@ -78,6 +88,10 @@ private:
 	void HandleDrag(int mouseX, int mouseY);
 
 	void CycleNodes(int direction);
+	bool IsFocusCandidate(Node* node, bool isFocusedNodeVisible);
+	Node* FindPreviousFocusCandidate(Node* start, bool isFocusedNodeVisible);
+	bool BuildFocusCandidates();
+	bool FindFocusCandidate(Node* node);
 
 	void ToggleStatusAndTitleBar();
 
@@ -107,6 +121,12 @@ private:
 	int scrollPositionY;
 	int pageHeightForDimensionScaling;
 
+	// Built the first time focus is cycled backwards once layout has finished, since the tree
+	// doesn't change after that. The position is kept so that each step back is a lookup
+	FocusCandidateBlock* firstFocusCandidateBlock;
+	FocusCandidateBlock* focusCandidateBlock;
+	int focusCandidateIndex;
+
 	char titleBuffer[MAX_TITLE_LENGTH];
 };
 
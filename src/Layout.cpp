@@ -7,7 +7,7 @@
 #include "Nodes/ImgNode.h"
 
 Layout::Layout(Page& inPage)
-	: page(inPage), cursorStack(MemoryManager::pageAllocator), paramStack(MemoryManager::pageAllocator)
+	: page(inPage), cursorStack(MemoryManager::pageAllocator), paramStack(MemoryManager::pageAllocator), measureStack(MemoryManager::pageAllocator)
 {
 }
 
@@ -15,23 +15,54 @@ void Layout::Reset()
 {
 	paramStack.Reset();
 	cursorStack.Reset();
+	measureStack.Reset();
 	currentLineHeight = 0;
 	lineStartNode = nullptr;
 	lastNodeContext = nullptr;
+	lineBoxSize = 0;
+	lineOverflowStartNode = nullptr;
 	currentNodeToProcess = nullptr;
+	restartNode = nullptr;
 	Cursor().Clear();
 	tableDepth = 0;
 	isFinished = false;
+	nodesLaidOut = 0;
+	numYields = 0;
 
 	LayoutParams& params = GetParams();
 	params.marginLeft = 0;
 	params.marginRight = page.GetApp().ui.windowRect.width;
+
+	ContentMeasure& measure = measureStack.Top();
+	measure.minContentWidth = 0;
+	measure.isWidthDependent = false;
 }
 
-void Layout::Update()
+// Lays out the nodes that the parser has emitted so far. A time slice or maximum node count of
+// zero means no limit. Layout carries on from the same node on the next call if it runs out
+void Layout::Update(clock_t timeSlice, long maxNodes)
 {
+	clock_t endTime = clock() + timeSlice;
+	long nodesThisUpdate = 0;
+
 	while (currentNodeToProcess && currentNodeToProcess != lastNodeToProcess)
 	{
+		if (maxNodes && nodesThisUpdate >= maxNodes)
+		{
+			numYields++;
+			return;
+		}
+
+		if (nodesThisUpdate && (nodesThisUpdate % LAYOUT_NODES_PER_BUDGET_CHECK) == 0)
+		{
+			if ((timeSlice && clock() > endTime) || Platform::input->HasInputPending())
+			{
+				// Give way so that scrolling and clicking stay responsive on large pages
+				numYields++;
+				return;
+			}
+		}
+
 		currentNodeToProcess->Handler().BeginLayoutContext(*this, currentNodeToProcess);
 
 		if (currentNodeToProcess->type == Node::Image && App::config.loadImages)
@@ -49,6 +80,8 @@ void Layout::Update()
 		}
 
 		currentNodeToProcess->Handler().GenerateLayout(*this, currentNodeToProcess);
+		nodesThisUpdate++;
+		nodesLaidOut++;
 
 		if (currentNodeToProcess->firstChild)
 		{
@@ -58,6 +91,13 @@ void Layout::Update()
 		{
 			currentNodeToProcess->Handler().EndLayoutContext(*this, currentNodeToProcess);
 
+			if (restartNode)
+			{
+				currentNodeToProcess = restartNode;
+				restartNode = nullptr;
+				continue;
+			}
+
 			if (!tableDepth && !lineStartNode)
 			{
 				page.GetApp().pageRenderer.MarkNodeLayoutComplete(currentNodeToProcess);
@@ -77,6 +117,13 @@ void Layout::Update()
 					{
 						currentNodeToProcess->Handler().EndLayoutContext(*this, currentNodeToProcess);
 
+						if (restartNode)
+						{
+							currentNodeToProcess = restartNode;
+							restartNode = nullptr;
+							break;
+						}
+
 						if (!tableDepth && !lineStartNode)
 						{
 							page.GetApp().pageRenderer.MarkNodeLayoutComplete(currentNodeToProcess);
@@ -111,40 +158,50 @@ void Layout::Update()
 
 void Layout::BreakNewLine()
 {
-	// Recenter items if required
-	//if (lineStartNode && lineStartNode->style.alignment == ElementAlignment::Center)
-	//{
-	//	int shift = AvailableWidth() / 2;
-	//	TranslateNodes(lineStartNode, shift, 0, true);
-	//}
-	
 	if (lineStartNode)
 	{
+		int shiftX = 0;
+
 		if (lineStartNode->GetStyle().alignment == ElementAlignment::Center)
 		{
-			int shift = AvailableWidth() / 2;
-			TranslateNodes(lineStartNode, lastNodeContext, shift, 0);
+			shiftX = AvailableWidth() / 2;
+			MarkWidthDependent();
 		}
 		else if (lineStartNode->GetStyle().alignment == ElementAlignment::Right)
 		{
-			int shift = AvailableWidth();
-			TranslateNodes(lineStartNode, lastNodeContext, shift, 0);
+			shiftX = AvailableWidth();
+			MarkWidthDependent();
 		}
-	}
 
-	if (lastNodeContext && !tableDepth)
-	{
-		//page.GetApp().pageRenderer.MarkNodeLayoutComplete(lastNodeContext);
+		for (int n = 0; n < lineBoxSize; n++)
+		{
+			LineBoxEntry& entry = lineBox[n];
+			entry.node->anchor.x += shiftX;
+			entry.node->anchor.y += currentLineHeight - entry.lineHeight;
+		}
+
+		if (lineOverflowStartNode && shiftX)
+		{
+			TranslateNodes(lineOverflowStartNode, lastNodeContext, shiftX, 0);
+		}
 	}
 
 	Cursor().x = GetParams().marginLeft;
 	Cursor().y += currentLineHeight;
 	currentLineHeight = 0;
 	lineStartNode = nullptr;
+	lineBoxSize = 0;
+	lineOverflowStartNode = nullptr;
 }
 
 void Layout::ProgressCursor(Node* nodeContext, int width, int lineHeight)
 {
+	if (nodeContext->type != Node::Text && nodeContext->type != Node::SubText)
+	{
+		// Anything other than a line of text is placed whole
+		AddUnbreakableWidth(width);
+	}
+
 	// Horrible hack to add padding / spacing between nodes. FIXME
 	if (width)
 	{
@@ -156,20 +213,59 @@ void Layout::ProgressCursor(Node* nodeContext, int width, int lineHeight)
 		lineStartNode = nodeContext;
 	}
 
-	lastNodeContext = nodeContext;
-
 	if (lineHeight > currentLineHeight)
 	{
-		// Line height has increased so move everything down accordingly
-		int deltaY = lineHeight - currentLineHeight;
-//		TranslateNodes(lineStartNode, 0, deltaY, true);
-		TranslateNodes(lineStartNode, nodeContext, 0, deltaY);
+		// The line has grown. The node was positioned against the old line height so move it down
+		// now, the rest of the line is moved down when the line is closed
+		nodeContext->anchor.y += lineHeight - currentLineHeight;
+
+		if (lineOverflowStartNode)
+		{
+			// Nodes that didn't fit in the line box have to be moved straight away
+			TranslateNodes(lineOverflowStartNode, lastNodeContext, 0, lineHeight - currentLineHeight);
+		}
 		currentLineHeight = lineHeight;
 	}
 
+	if (lineBoxSize < MAX_LINE_BOX_ENTRIES)
+	{
+		LineBoxEntry& entry = lineBox[lineBoxSize++];
+		entry.node = nodeContext;
+		entry.lineHeight = currentLineHeight;
+	}
+	else if (!lineOverflowStartNode)
+	{
+		lineOverflowStartNode = nodeContext;
+	}
+
+	lastNodeContext = nodeContext;
+
 	Cursor().x += width;
 }
 
+// Starts measuring a table cell's contents. The enclosing measurement carries on once it ends
+void Layout::BeginMeasure()
+{
+	measureStack.Push();
+
+	ContentMeasure& measure = measureStack.Top();
+	measure.minContentWidth = 0;
+	measure.isWidthDependent = false;
+}
+
+ContentMeasure Layout::EndMeasure()
+{
+	ContentMeasure result = measureStack.Top();
+	measureStack.Pop();
+
+	// Content that depends on the width of a nested cell depends on the width around it too
+	if (result.isWidthDependent)
+	{
+		MarkWidthDependent();
+	}
+	return result;
+}
+
 void Layout::TranslateNodes(Node* start, Node* end, int deltaX, int deltaY)
 {
 	for (Node* node = start; node; node = node->GetNextInTree())
@@ -208,6 +304,7 @@ void Layout::PadHorizontal(int left, int right)
 	{
 		params.marginLeft = (params.marginLeft + left + params.marginRight - right) / 2;
 		params.marginRight = params.marginLeft + 1;
+		MarkWidthDependent();
 	}
 	else
 	{
@@ -228,6 +325,10 @@ void Layout::RestrictHorizontal(int maxWidth)
 	{
 		params.marginRight = marginRight;
 	}
+	else
+	{
+		MarkWidthDependent();
+	}
 }
 
 void Layout::PadVertical(int down)
@@ -249,6 +350,12 @@ void Layout::RecalculateLayoutForNode(Node* targetNode)
 
 	targetNode->Handler().EndLayoutContext(*this, targetNode);
 
+	if (restartNode == targetNode)
+	{
+		restartNode = nullptr;
+		RecalculateLayoutForNode(targetNode);
+	}
+
 #if 0
 	Node* node = targetNode;
 	bool checkChildren = true;
@@ -306,6 +413,7 @@ void Layout::RecalculateLayout()
 	RecalculateLayoutForNode(node);
 
 	page.GetApp().pageRenderer.MarkPageLayoutComplete();
+	page.GetApp().pageRenderer.MarkPageRelaidOut();
 	page.GetApp().pageRenderer.RefreshAll();
 
 #ifdef _WIN32
@@ -324,6 +432,7 @@ int Layout::CalculateWidth(ExplicitDimension explicitWidth)
 	{
 		if (explicitWidth.IsPercentage())
 		{
+			MarkWidthDependent();
 			return ((long)MaxAvailableWidth() * explicitWidth.Value()) / 100;
 		}
 		else
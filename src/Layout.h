@@ -1,10 +1,20 @@
 #pragma once
 
+#include <time.h>
 #include "Node.h"
 #include "Stack.h"
 
 #define RESCALE_TO_FIT_SCREEN_WIDTH 1
 
+// Layout gives way to input handling and rendering after this long
+#define LAYOUT_TIME_SLICE (CLOCKS_PER_SEC / 10)
+
+// How many nodes are laid out between checks of the clock and input
+#define LAYOUT_NODES_PER_BUDGET_CHECK 16
+
+// Nodes on a line beyond this are moved with a tree walk instead
+#define MAX_LINE_BOX_ENTRIES 64
+
 class Page;
 class Node;
 
@@ -13,6 +23,19 @@ struct LayoutParams
 	int marginLeft, marginRight;
 };
 
+// Found while the contents of a table cell are measured
+struct ContentMeasure
+{
+	int minContentWidth;		// Widest piece of content that can't be broken across lines
+	bool isWidthDependent;		// The available width changed how the content was laid out
+};
+
+struct LineBoxEntry
+{
+	Node* node;
+	int lineHeight;			// Line height that the node's anchor was positioned against
+};
+
 class Layout
 {
 public:
@@ -20,7 +43,7 @@ public:
 	Layout(Page& page);
 
 	void Reset();
-	void Update();
+	void Update(clock_t timeSlice = LAYOUT_TIME_SLICE, long maxNodes = 0);
 
 	Page& page;
 
@@ -37,9 +60,24 @@ public:
 	void MarkParsingComplete();
 	void ProgressCursor(Node* nodeContext, int width, int lineHeight);
 
+	void BeginMeasure();
+	ContentMeasure EndMeasure();
+	void MarkWidthDependent() { measureStack.Top().isWidthDependent = true; }
+	void AddUnbreakableWidth(int width)
+	{
+		if (width > measureStack.Top().minContentWidth)
+		{
+			measureStack.Top().minContentWidth = width;
+		}
+	}
+
 	void RecalculateLayout();
 	void RecalculateLayoutForNode(Node* node);
 
+	// Called from EndLayoutContext to lay the node out again from its start, e.g. once a table has
+	// measured its cells. This goes through Update so the time budget applies to the second pass
+	void RestartNode(Node* node) { restartNode = node; }
+
 	int CalculateWidth(ExplicitDimension explicitWidth);
 	int CalculateHeight(ExplicitDimension explicitHeight);
 
@@ -54,12 +92,21 @@ public:
 	int MaxAvailableWidth() { return GetParams().marginRight - GetParams().marginLeft; }
 
 	bool IsFinished() { return isFinished; }
+	long GetNodesLaidOut() { return nodesLaidOut; }
+	long GetNumYields() { return numYields; }
 
 	Node* lineStartNode;
 	Node* lastNodeContext;
 
+	// Nodes placed on the current line. They are moved down to the final line height and
+	// shifted for alignment in a single pass when the line is closed
+	LineBoxEntry lineBox[MAX_LINE_BOX_ENTRIES];
+	int lineBoxSize;
+	Node* lineOverflowStartNode;
+
 	Node* currentNodeToProcess;
 	Node* lastNodeToProcess;
+	Node* restartNode;
 
 	Coord& Cursor()
 	{
@@ -74,10 +121,14 @@ public:
 	int tableDepth;
 
 	Stack<LayoutParams> paramStack;
+	Stack<ContentMeasure> measureStack;
 
 	void TranslateNodes(Node* start, Node* end, int deltaX, int deltaY);
 
 	bool isFinished;
+
+	long nodesLaidOut;
+	long numYields;			// Times that Update ran out of budget with nodes still waiting
 };
 
 /*
@@ -0,0 +1,343 @@
+//
+// Copyright (C) 2021 James Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+
+// Headless benchmark for the parser and layout. Each file is fed through the parser in
+// fixed size chunks with a layout update after each chunk, the same as a page arriving
+// over the network, and the time spent in each is reported.
+//
+// With -check, each file is also laid out with tables measuring their cells on every pass, and
+// any node that ends up somewhere different is reported.
+//
+// With -maxnodes, each layout update stops after that many nodes, so layout has to carry on
+// from where it yielded the same as when input is waiting.
+//
+// Usage: bench [-chunk=bytes] [-iterations=count] [-maxnodes=count] [-check] [-video=mode] [-assets=path] files...
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../Platform.h"
+#include "../App.h"
+#include "../Node.h"
+#include "../Style.h"
+#include "../Tags.h"
+#include "../Nodes/Table.h"
+#include "../Memory/Memory.h"
+
+#define DEFAULT_CHUNK_SIZE 256
+#define DEFAULT_ITERATIONS 10
+
+struct BenchResult
+{
+	long bytes;
+	long nodes;
+	double parseTime;
+	double layoutTime;
+	long tagLookups;
+	long tagComparisons;
+	long allocated;
+	int styles;
+	long nodesLaidOut;
+	long layoutYields;
+};
+
+static long layoutMaxNodes = 0;
+
+static double GetTime()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static char* LoadFile(const char* path, long& length)
+{
+	FILE* fs = fopen(path, "rb");
+	if (!fs)
+	{
+		return NULL;
+	}
+
+	fseek(fs, 0, SEEK_END);
+	length = ftell(fs);
+	fseek(fs, 0, SEEK_SET);
+
+	char* buffer = (char*) malloc(length);
+	if (buffer && fread(buffer, 1, length, fs) != (size_t) length)
+	{
+		free(buffer);
+		buffer = NULL;
+	}
+
+	fclose(fs);
+	return buffer;
+}
+
+static void ResetPage(App& app)
+{
+	StylePool::Get().Reset();
+	app.page.Reset();
+	app.parser.Reset();
+	app.pageRenderer.Reset();
+	app.ui.Reset();
+	tagLookupStats.lookups = 0;
+	tagLookupStats.comparisons = 0;
+}
+
+static void RunFile(App& app, char* buffer, long length, long chunkSize, BenchResult& result)
+{
+	ResetPage(app);
+	app.parser.SetContentType("text/html");
+
+	double parseTime = 0;
+	double layoutTime = 0;
+
+	for (long offset = 0; offset < length; offset += chunkSize)
+	{
+		long count = length - offset < chunkSize ? length - offset : chunkSize;
+
+		double startTime = GetTime();
+		app.parser.Parse(buffer + offset, count);
+		double parsedTime = GetTime();
+		app.page.layout.Update(LAYOUT_TIME_SLICE, layoutMaxNodes);
+		double laidOutTime = GetTime();
+
+		parseTime += parsedTime - startTime;
+		layoutTime += laidOutTime - parsedTime;
+	}
+
+	double startTime = GetTime();
+	app.parser.Finish();
+	double parsedTime = GetTime();
+	while (!app.page.layout.IsFinished())
+	{
+		app.page.layout.Update(LAYOUT_TIME_SLICE, layoutMaxNodes);
+	}
+	double laidOutTime = GetTime();
+
+	parseTime += parsedTime - startTime;
+	layoutTime += laidOutTime - parsedTime;
+
+	long nodes = 0;
+	for (Node* node = app.page.GetRootNode(); node; node = node->GetNextInTree())
+	{
+		nodes++;
+	}
+
+	result.bytes = length;
+	result.nodes = nodes;
+	result.parseTime += parseTime;
+	result.layoutTime += layoutTime;
+	result.tagLookups = tagLookupStats.lookups;
+	result.tagComparisons = tagLookupStats.comparisons;
+	result.allocated = MemoryManager::pageAllocator.TotalUsed();
+	result.styles = StylePool::Get().GetNumStyles();
+	result.nodesLaidOut = app.page.layout.GetNodesLaidOut();
+	result.layoutYields = app.page.layout.GetNumYields();
+}
+
+struct NodeGeometry
+{
+	Coord anchor;
+	Coord size;
+};
+
+// Lays the file out again with every table measuring its cells, and counts the nodes that
+// don't match the layout from reusing cached cell widths
+static long CheckTableLayout(App& app, char* buffer, long length, long chunkSize)
+{
+	BenchResult result = { 0 };
+	RunFile(app, buffer, length, chunkSize, result);
+
+	long count = 0;
+	for (Node* node = app.page.GetRootNode(); node; node = node->GetNextInTree())
+	{
+		count++;
+	}
+
+	NodeGeometry* geometry = (NodeGeometry*) malloc(count * sizeof(NodeGeometry));
+	if (!geometry)
+	{
+		return -1;
+	}
+
+	long index = 0;
+	for (Node* node = app.page.GetRootNode(); node; node = node->GetNextInTree(), index++)
+	{
+		geometry[index].anchor = node->anchor;
+		geometry[index].size = node->size;
+	}
+
+	reuseTableCellWidths = false;
+	RunFile(app, buffer, length, chunkSize, result);
+	reuseTableCellWidths = true;
+
+	long mismatches = 0;
+	index = 0;
+	for (Node* node = app.page.GetRootNode(); node && index < count; node = node->GetNextInTree(), index++)
+	{
+		if (node->size.x != geometry[index].size.x || node->size.y != geometry[index].size.y)
+		{
+			mismatches++;
+		}
+		else if ((node->size.x || node->size.y)
+			&& (node->anchor.x != geometry[index].anchor.x || node->anchor.y != geometry[index].anchor.y))
+		{
+			// Nodes without a size, like text that has been split into lines, keep wherever they
+			// were last placed so only the position of nodes that take up space is compared
+			mismatches++;
+		}
+	}
+
+	free(geometry);
+	return mismatches;
+}
+
+static void PrintResult(const char* name, BenchResult& result)
+{
+	double totalTime = result.parseTime + result.layoutTime;
+
+	printf("%-24s %10ld %8ld %10.3f %10.3f %10.2f %12.0f %10ld %8ld %12ld %12ld %10.2f", name, result.bytes, result.nodes,
+		result.parseTime * 1000.0, result.layoutTime * 1000.0,
+		result.parseTime > 0 ? result.bytes / result.parseTime / (1024.0 * 1024.0) : 0.0,
+		totalTime > 0 ? result.nodes / totalTime : 0.0,
+		result.nodesLaidOut, result.layoutYields,
+		result.tagLookups, result.tagComparisons,
+		result.tagLookups > 0 ? (double) result.tagComparisons / result.tagLookups : 0.0);
+}
+
+int main(int argc, char* argv[])
+{
+	long chunkSize = DEFAULT_CHUNK_SIZE;
+	int iterations = DEFAULT_ITERATIONS;
+	bool checkTables = false;
+	int exitCode = 0;
+
+	for (int n = 1; n < argc; n++)
+	{
+		if (strstr(argv[n], "-chunk=") == argv[n])
+		{
+			chunkSize = atol(argv[n] + 7);
+		}
+		else if (strstr(argv[n], "-iterations=") == argv[n])
+		{
+			iterations = atoi(argv[n] + 12);
+		}
+		else if (strstr(argv[n], "-maxnodes=") == argv[n])
+		{
+			layoutMaxNodes = atol(argv[n] + 10);
+		}
+		else if (!strcmp(argv[n], "-check"))
+		{
+			checkTables = true;
+		}
+	}
+
+	if (chunkSize <= 0 || iterations <= 0 || layoutMaxNodes < 0)
+	{
+		fprintf(stderr, "Invalid chunk size, iteration count or node limit\n");
+		return 1;
+	}
+
+	if (!Platform::Init(argc, argv))
+	{
+		return 1;
+	}
+
+	const char* unhashedTag = FindUnhashedTag();
+	if (unhashedTag)
+	{
+		fprintf(stderr, "Tag <%s> isn't in the tag hash table\n", unhashedTag);
+		Platform::Shutdown();
+		return 1;
+	}
+
+	App* app = new App();
+	App::config.loadImages = false;
+
+	MemoryManager::pageBlockAllocator.Init();
+	StylePool::Get().Init();
+	app->ui.Init();
+	app->page.Reset();
+	app->pageRenderer.Init();
+
+	printf("Chunk size %ld bytes, %d iterations\n", chunkSize, iterations);
+	printf("%-24s %10s %8s %10s %10s %10s %12s %10s %8s %12s %12s %10s %10s %8s\n", "File", "Bytes", "Nodes", "Parse ms", "Layout ms",
+		"Parse MB/s", "Nodes/s", "Laid out", "Yields", "Tag lookups", "Tag compares", "Cmp/lookup", "Allocated", "Styles");
+
+	BenchResult total = { 0 };
+
+	for (int n = 1; n < argc; n++)
+	{
+		if (*argv[n] == '-')
+		{
+			continue;
+		}
+
+		long length;
+		char* buffer = LoadFile(argv[n], length);
+		if (!buffer)
+		{
+			fprintf(stderr, "Could not load %s\n", argv[n]);
+			continue;
+		}
+
+		BenchResult result = { 0 };
+		for (int i = 0; i < iterations; i++)
+		{
+			RunFile(*app, buffer, length, chunkSize, result);
+		}
+
+		long mismatches = checkTables ? CheckTableLayout(*app, buffer, length, chunkSize) : 0;
+		free(buffer);
+
+		// Times are averaged over the iterations. Byte, node, allocator, style pool and tag lookup counts are
+		// the same on each iteration, so these are from the last timed one. They are captured at the end of
+		// RunFile, so the check run above doesn't affect them
+		result.parseTime /= iterations;
+		result.layoutTime /= iterations;
+
+		const char* name = strrchr(argv[n], '/') ? strrchr(argv[n], '/') + 1 : argv[n];
+		PrintResult(name, result);
+		printf(" %10ld %8d\n", result.allocated, result.styles);
+
+		if (mismatches < 0)
+		{
+			fprintf(stderr, "Not enough memory to check %s\n", name);
+		}
+		else if (mismatches)
+		{
+			printf("%s: %ld nodes laid out differently when table cells are measured again\n", name, mismatches);
+			exitCode = 1;
+		}
+
+		total.bytes += result.bytes;
+		total.nodes += result.nodes;
+		total.parseTime += result.parseTime;
+		total.layoutTime += result.layoutTime;
+		total.tagLookups += result.tagLookups;
+		total.tagComparisons += result.tagComparisons;
+		total.nodesLaidOut += result.nodesLaidOut;
+		total.layoutYields += result.layoutYields;
+	}
+
+	PrintResult("Total", total);
+	printf("\n");
+
+	delete app;
+	Platform::Shutdown();
+
+	return exitCode;
+}
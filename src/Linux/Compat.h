@@ -0,0 +1,26 @@
+//
+// Copyright (C) 2021 James Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+
+#ifndef _COMPAT_H_
+#define _COMPAT_H_
+
+// Force included when building for Linux to supply the DOS / Windows C library names
+
+#include <string.h>
+#include <strings.h>
+
+#define stricmp strcasecmp
+#define strnicmp strncasecmp
+
+#endif
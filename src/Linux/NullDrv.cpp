@@ -0,0 +1,90 @@
+//
+// Copyright (C) 2021 James Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <dirent.h>
+#include "NullDrv.h"
+#include "../DataPack.h"
+#include "../VidModes.h"
+#include "../Draw/Surf8bpp.h"
+
+const char* NullVideoDriver::assetsPath = ".";
+
+NullVideoDriver::NullVideoDriver()
+: frameBuffer(NULL)
+{
+}
+
+// The data pack names are upper case, which won't match the checked out files
+// on a case sensitive file system, so search the assets directory for them
+static bool LoadDataPack(const char* directory, const char* filename)
+{
+	DIR* dir = opendir(directory);
+	if (!dir)
+	{
+		return false;
+	}
+
+	bool found = false;
+	struct dirent* entry;
+
+	while (!found && (entry = readdir(dir)) != NULL)
+	{
+		if (!strcasecmp(entry->d_name, filename))
+		{
+			char path[512];
+			snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+			found = Assets.Load(path);
+		}
+	}
+
+	closedir(dir);
+	return found;
+}
+
+void NullVideoDriver::Init(VideoModeInfo* inVideoMode)
+{
+	videoMode = inVideoMode;
+
+	screenWidth = videoMode->screenWidth;
+	screenHeight = videoMode->screenHeight;
+
+	const char* dataPackFilename = DataPack::GetPresetFilename((DataPack::Preset) videoMode->dataPackIndex);
+	if (!LoadDataPack(assetsPath, dataPackFilename))
+	{
+		Platform::FatalError("Could not find %s in %s", dataPackFilename, assetsPath);
+	}
+
+	// Whatever the mode, draw to a byte per pixel surface so that any resolution works
+	frameBuffer = new uint8_t[screenWidth * screenHeight];
+	memset(frameBuffer, 0xf, screenWidth * screenHeight);
+
+	DrawSurface_8BPP* surface = new DrawSurface_8BPP(screenWidth, screenHeight);
+	for (int y = 0; y < screenHeight; y++)
+	{
+		surface->lines[y] = frameBuffer + y * screenWidth;
+	}
+	drawSurface = surface;
+
+	colourScheme = colourScheme666;
+	paletteLUT = nullptr;
+}
+
+void NullVideoDriver::Shutdown()
+{
+	delete[] frameBuffer;
+	frameBuffer = NULL;
+}
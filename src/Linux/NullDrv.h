@@ -0,0 +1,50 @@
+//
+// Copyright (C) 2021 James Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+
+#ifndef _NULLDRV_H_
+#define _NULLDRV_H_
+
+#include "../Platform.h"
+
+// Drivers for running the browser core without any hardware, e.g. for benchmarking.
+// Drawing goes to an 8bpp surface in memory and there is never any input
+
+class NullVideoDriver : public VideoDriver
+{
+public:
+	NullVideoDriver();
+
+	virtual void Init(VideoModeInfo* videoMode);
+	virtual void Shutdown();
+
+	static const char* assetsPath;
+
+private:
+	uint8_t* frameBuffer;
+};
+
+class NullInputDriver : public InputDriver
+{
+public:
+	virtual void HideMouse() {}
+	virtual void ShowMouse() {}
+	virtual void SetMouseCursor(MouseCursor::Type type) {}
+	virtual void GetMouseStatus(int& buttons, int& x, int& y) { buttons = x = y = 0; }
+	virtual void SetMousePosition(int x, int y) {}
+
+	virtual bool GetMouseButtonPress(int& x, int& y) { return false; }
+	virtual bool GetMouseButtonRelease(int& x, int& y) { return false; }
+};
+
+#endif
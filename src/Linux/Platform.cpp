@@ -0,0 +1,100 @@
+//
+// Copyright (C) 2021 James Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <ctype.h>
+#include "../Platform.h"
+#include "../VidModes.h"
+#include "../Draw/Surface.h"
+#include "../Memory/Memory.h"
+#include "NullDrv.h"
+
+NullVideoDriver nullVideoDriver;
+NullInputDriver nullInputDriver;
+NetworkDriver nullNetworkDriver;
+
+VideoDriver* Platform::video = &nullVideoDriver;
+NetworkDriver* Platform::network = &nullNetworkDriver;
+InputDriver* Platform::input = &nullInputDriver;
+
+bool Platform::Init(int argc, char* argv[])
+{
+	VideoModeInfo* videoMode = nullptr;
+
+	for (int n = 1; n < argc; n++)
+	{
+		if (strstr(argv[n], "-video=") == argv[n])
+		{
+			int chosenMode = tolower(argv[n][7]) - 'a';
+			if (chosenMode >= 0 && chosenMode < GetNumVideoModes() && VideoModeList[chosenMode].name)
+			{
+				videoMode = &VideoModeList[chosenMode];
+			}
+		}
+		else if (strstr(argv[n], "-assets=") == argv[n])
+		{
+			NullVideoDriver::assetsPath = argv[n] + 8;
+		}
+	}
+
+	if (!videoMode)
+	{
+		// Default to 640x480 in 256 colours, the same as the Windows build
+		for (videoMode = VideoModeList; videoMode->name; videoMode++)
+		{
+			if (videoMode->screenWidth == 640 && videoMode->screenHeight == 480 && videoMode->surfaceFormat == DrawSurface::Format_8BPP_VESA)
+			{
+				break;
+			}
+		}
+		if (!videoMode->name)
+		{
+			videoMode = VideoModeList;
+		}
+	}
+
+	network->Init();
+	video->Init(videoMode);
+	input->Init();
+
+	return true;
+}
+
+void Platform::Shutdown()
+{
+	MemoryManager::pageBlockAllocator.Shutdown();
+	input->Shutdown();
+	video->Shutdown();
+	network->Shutdown();
+}
+
+void Platform::Update()
+{
+	network->Update();
+}
+
+void Platform::FatalError(const char* message, ...)
+{
+	va_list args;
+
+	va_start(args, message);
+	vfprintf(stderr, message, args);
+	va_end(args);
+
+	fprintf(stderr, "\n");
+
+	exit(1);
+}
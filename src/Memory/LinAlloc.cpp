@@ -67,3 +67,26 @@ void* LinearAllocator::Allocate(size_t numBytes)
 	allocOffset += numBytes;
 	return NormalizeFarPointer(result);
 }
+
+// Grows or shrinks the most recent allocation without moving it. Fails if something else has
+// been allocated since or the new size doesn't fit in the current chunk
+bool LinearAllocator::Resize(void* ptr, size_t oldSize, size_t newSize)
+{
+	oldSize += oldSize & (LINEAR_ALLOC_ALIGNMENT - 1);
+	newSize += newSize & (LINEAR_ALLOC_ALIGNMENT - 1);
+
+	if (!currentChunk || oldSize > allocOffset)
+	{
+		return false;
+	}
+
+	size_t offset = allocOffset - oldSize;
+	if (NormalizeFarPointer(&currentChunk->data[offset]) != ptr || offset + newSize > CHUNK_DATA_SIZE)
+	{
+		return false;
+	}
+
+	totalBytesUsed += (long)newSize - (long)oldSize;
+	allocOffset = offset + newSize;
+	return true;
+}
@@ -56,6 +56,7 @@ public:
 
 	void Reset();
 	virtual void* Allocate(size_t numBytes);
+	bool Resize(void* ptr, size_t oldSize, size_t newSize);
 
 	long TotalAllocated() { return numAllocatedChunks * sizeof(Chunk); }
 	long TotalUsed() { return totalBytesUsed; }
@@ -125,11 +125,10 @@ MemBlockHandle MemBlockAllocator::AllocString(const char* inString)
 	return result;
 }
 
-MemBlockHandle MemBlockAllocator::Allocate(uint16_t size)
+MemBlockHandle MemBlockAllocator::AllocateExpanded(uint16_t size)
 {
 	MemBlockHandle result;
 
-	// Use EMS if available
 #ifdef __DOS__
 	if (ems.IsAvailable())
 	{
@@ -151,11 +150,20 @@ MemBlockHandle MemBlockAllocator::Allocate(uint16_t size)
 		}
 	}
 #endif
-	
-	long conventionalMemoryAvailable = MemoryManager::GetConventionalMemoryAvailableKB() * 1024L;
-	conventionalMemoryAvailable += MemoryManager::pageAllocator.TotalAllocated() - MemoryManager::pageAllocator.TotalUsed();
 
-	if (swapFile && conventionalMemoryAvailable < 16 * 1024)	// If we have less than 16K of conventional memory available, fall back to disk
+	return result;
+}
+
+MemBlockHandle MemBlockAllocator::Allocate(uint16_t size)
+{
+	// Use EMS if available
+	MemBlockHandle result = AllocateExpanded(size);
+	if (result.IsAllocated())
+	{
+		return result;
+	}
+	
+	if (swapFile && IsConventionalMemoryLow())
 	{
 		uint16_t sizeNeededForSwap = size + sizeof(uint16_t);
 
@@ -199,6 +207,93 @@ MemBlockHandle MemBlockAllocator::Allocate(uint16_t size)
 	return result;
 }
 
+MemBlockHandle MemBlockAllocator::AllocateGrowable(uint16_t size)
+{
+	MemBlockHandle result;
+
+#ifdef __DOS__
+	if (ems.IsAvailable())
+	{
+		result = ems.Allocate(size);
+		if (result.IsAllocated())
+		{
+			totalAllocated += size;
+			return result;
+		}
+	}
+
+	// XMS is only reached through a copy buffer so can't be written in place
+	if (xms.IsAvailable())
+	{
+		return result;
+	}
+#endif
+
+	// An EMS sized block that didn't fit would only flag an error in the linear allocator
+	if ((swapFile && IsConventionalMemoryLow()) || size > CHUNK_DATA_SIZE - LINEAR_ALLOC_ALIGNMENT)
+	{
+		return result;
+	}
+
+	result.conventionalPointer = MemoryManager::pageAllocator.Allocate(size);
+	if (result.conventionalPointer)
+	{
+		result.type = MemBlockHandle::Conventional;
+		totalAllocated += size;
+	}
+
+	return result;
+}
+
+bool MemBlockAllocator::Resize(MemBlockHandle& handle, uint16_t oldSize, uint16_t newSize)
+{
+	bool resized = false;
+
+	switch (handle.type)
+	{
+	case MemBlockHandle::Conventional:
+		resized = MemoryManager::pageAllocator.Resize(handle.conventionalPointer, oldSize, newSize);
+		break;
+#ifdef __DOS__
+	case MemBlockHandle::EMS:
+		resized = ems.Resize(handle, oldSize, newSize);
+		break;
+#endif
+	default:
+		break;
+	}
+
+	if (resized)
+	{
+		totalAllocated += (long)newSize - (long)oldSize;
+	}
+	return resized;
+}
+
+uint16_t MemBlockAllocator::MaxGrowableSize(MemBlockHandle& handle)
+{
+	switch (handle.type)
+	{
+	case MemBlockHandle::Conventional:
+		// The linear allocator rejects a request that fills the whole chunk
+		return (uint16_t)(CHUNK_DATA_SIZE - LINEAR_ALLOC_ALIGNMENT);
+#ifdef __DOS__
+	case MemBlockHandle::EMS:
+		return (uint16_t)EMS_PAGE_SIZE;
+#endif
+	default:
+		return 0;
+	}
+}
+
+// If we have less than 16K of conventional memory available, fall back to disk
+bool MemBlockAllocator::IsConventionalMemoryLow()
+{
+	long conventionalMemoryAvailable = MemoryManager::GetConventionalMemoryAvailableKB() * 1024L;
+	conventionalMemoryAvailable += MemoryManager::pageAllocator.TotalAllocated() - MemoryManager::pageAllocator.TotalUsed();
+	return conventionalMemoryAvailable < 16 * 1024;
+}
+
 void* MemBlockAllocator::AccessSwap(MemBlockHandle& handle)
 {
 	if (swapFile && lastSwapRead != handle.swapFilePosition)
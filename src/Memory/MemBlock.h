@@ -65,9 +65,24 @@ public:
 	MemBlockHandle Allocate(uint16_t size);
 	MemBlockHandle AllocString(const char* inString);
 
+	// Blocks from EMS or XMS only, so that they don't use up conventional memory or the swap file.
+	// Returns an unallocated handle if neither is available
+	MemBlockHandle AllocateExpanded(uint16_t size);
+
+	// Blocks that can be written through their pointer and resized while they are the most
+	// recent allocation. Returns an unallocated handle if the preferred backing store can't do this
+	MemBlockHandle AllocateGrowable(uint16_t size);
+	bool Resize(MemBlockHandle& handle, uint16_t oldSize, uint16_t newSize);
+
+	// Largest size a growable block can reach in its backing store: one linear allocator
+	// chunk for conventional memory, one page frame page for EMS
+	uint16_t MaxGrowableSize(MemBlockHandle& handle);
+
 	long TotalAllocated() { return totalAllocated; }
 	long SwapAllocated() { return swapFileLength; }
 
+	bool IsConventionalMemoryLow();
+
 	void Reset();
 
 private:
@@ -58,6 +58,14 @@ Node::Node(Type inType)
 }
 
 void Node::AddChild(Node* child)
+{
+	Node* lastChild = nullptr;
+	AddChild(child, lastChild);
+}
+
+// lastChild is a hint for where the search for the end of the child list starts, and is updated
+// to the new child. Keeping hold of it between calls makes appending lots of children linear
+void Node::AddChild(Node* child, Node*& lastChild)
 {
 	if (!child)
 		return;
@@ -71,10 +79,19 @@ void Node::AddChild(Node* child)
 	}
 	else
 	{
-		Node* lastChild;
-		for(lastChild = firstChild.Get(); lastChild->next; lastChild = lastChild->next.Get()) {}
+		if (!lastChild)
+		{
+			lastChild = firstChild.Get();
+		}
+		// Siblings may have been inserted after the hint
+		while (lastChild->next)
+		{
+			lastChild = lastChild->next.Get();
+		}
 		lastChild->next = child;
 	}
+
+	lastChild = child;
 }
 
 void Node::InsertSibling(Node* sibling)
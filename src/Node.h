@@ -151,6 +151,7 @@ public:
 
 	Node(Type inType);
 	void AddChild(Node* child);
+	void AddChild(Node* child, Node*& lastChild);
 	void InsertSibling(Node* sibling);
 	void CalculateEncapsulatingRect(Rect& rect);
 	bool IsPointInsideNode(int x, int y);
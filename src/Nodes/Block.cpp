@@ -30,6 +30,7 @@ void BlockNode::EndLayoutContext(Layout& layout, Node* node)
 	if (node->firstChild)
 	{
 		node->size.x = layout.MaxAvailableWidth();
+		layout.MarkWidthDependent();
 		layout.PopLayout();
 		layout.BreakNewLine();
 		layout.PadVertical(data->verticalPadding);
@@ -47,6 +47,7 @@ void BreakNode::GenerateLayout(Layout& layout, Node* node)
 		node->anchor.x += 8;
 		node->anchor.y -= breakPadding;
 		node->size.x = layout.AvailableWidth() - 16;
+		layout.MarkWidthDependent();
 		node->size.y = breakPadding;
 		if (!breakPadding)
 		{
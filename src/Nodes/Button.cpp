@@ -79,6 +79,7 @@ void ButtonNode::GenerateLayout(Layout& layout, Node* node)
 	if (layout.AvailableWidth() < node->size.x)
 	{
 		layout.BreakNewLine();
+		layout.MarkWidthDependent();
 	}
 
 	node->anchor = layout.GetCursor(node->size.y);
@@ -140,11 +140,13 @@ void TextFieldNode::GenerateLayout(Layout& layout, Node* node)
 	if (layout.MaxAvailableWidth() < node->size.x)
 	{
 		node->size.x = layout.MaxAvailableWidth();
+		layout.MarkWidthDependent();
 	}
 
 	if (layout.AvailableWidth() < node->size.x)
 	{
 		layout.BreakNewLine();
+		layout.MarkWidthDependent();
 	}
 
 	node->anchor = layout.GetCursor(node->size.y);
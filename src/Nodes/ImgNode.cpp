@@ -108,6 +108,7 @@ void ImageNode::GenerateLayout(Layout& layout, Node* node)
 		{
 			int imageWidth = data->image.width;
 			data->image.width = layout.MaxAvailableWidth();
+			layout.MarkWidthDependent();
 			data->image.height = (uint16_t)(((long)data->image.height * data->image.width) / imageWidth);
 		}
 	}
@@ -118,6 +119,7 @@ void ImageNode::GenerateLayout(Layout& layout, Node* node)
 	if (layout.AvailableWidth() < node->size.x)
 	{
 		layout.BreakNewLine();
+		layout.MarkWidthDependent();
 	}
 
 	node->anchor = layout.GetCursor(node->size.y);
@@ -63,6 +63,7 @@ void ListItemNode::BeginLayoutContext(Layout& layout, Node* node)
 	node->anchor = layout.GetCursor();
 	//node->anchor.y += (font->glyphHeight - Assets.bulletIcon->height) / 2;
 	node->size.x = layout.AvailableWidth();
+	layout.MarkWidthDependent();
 	layout.PushLayout();
 
 	int margin = font->GetGlyphWidth(BULLET_CHARACTER) * 2;
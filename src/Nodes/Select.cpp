@@ -93,6 +93,7 @@ void SelectNode::EndLayoutContext(Layout& layout, Node* node)
 	if (layout.AvailableWidth() < node->size.x)
 	{
 		layout.BreakNewLine();
+		layout.MarkWidthDependent();
 	}
 
 	node->anchor = layout.GetCursor(node->size.y);
@@ -10,8 +10,15 @@
  * 1) Each cell has its content generated with the maximum available width to
  *    work out the preferred size
  * 2) Column and row dimensions are calculated based on preferred sizes
+ *
+ * When a finished table is laid out again at a different width, the cells' cached min and max
+ * content widths are often enough to solve the columns without measuring the cells again
  */
 
+#ifdef MWBENCH
+bool reuseTableCellWidths = true;
+#endif
+
 TableNode::Data* TableNode::Construct(Allocator& allocator)
 {
 	TableNode::Data* data = allocator.Alloc<TableNode::Data>();
@@ -53,6 +60,345 @@ void TableNode::Draw(DrawContext& context, Node* node)
 	}
 }
 
+// Width of a cell's contents at the table's available width, from the widths cached when the cell
+// was last measured. Returns -1 if the cell has to be measured again
+static int GetCellContentWidth(Layout& layout, TableNode::Data* data, TableCellNode::Data* cell, int availableWidth, int maxConstrainedTableWidth)
+{
+	if (!cell->firstChild)
+	{
+		// An empty cell has nothing to wrap, so its measured width holds at any width
+		return cell->contentWidth;
+	}
+
+	if (availableWidth >= cell->maxContentWidth)
+	{
+		// The contents fit without wrapping, the same as when they were measured
+		return cell->contentWidth;
+	}
+
+	layout.MarkWidthDependent();
+
+	if (availableWidth == data->lastAvailableWidth)
+	{
+		return cell->contentWidth;
+	}
+
+	if (availableWidth > data->lastAvailableWidth && 2 * data->cellPadding + cell->minContentWidth >= maxConstrainedTableWidth)
+	{
+		// Nothing that can't be broken gets narrower with more room, so the contents are still at
+		// least as wide as the table allows
+		return cell->minContentWidth;
+	}
+
+	return -1;
+}
+
+// Works out the column widths from the widths of the cell contents when laid out without
+// any restriction. Sets the total width of the table. Returns false if a cell's width at the
+// current available width isn't known without measuring it again
+static bool CalculateColumnWidths(Layout& layout, Node* node)
+{
+	TableNode::Data* data = static_cast<TableNode::Data*>(node);
+	int availableWidth = layout.MaxAvailableWidth();
+
+	int minCellWidth = 16;
+
+	for (int n = 0; n < data->numColumns; n++)
+	{
+		data->columns[n].Clear();
+		//data->columns[n].preferredWidth = minCellWidth;
+	}
+
+	int maxConstrainedTableWidth = availableWidth;
+	if (data->explicitWidth.IsSet())
+	{
+		maxConstrainedTableWidth = layout.CalculateWidth(data->explicitWidth);
+	}
+
+	// Find out preferred column widths in two passes:
+	// - First pass, check with cells of column span = 1
+	// - Second pass for cells of column span > 1
+	for (int pass = 0; pass < 2; pass++)
+	{
+		for (TableRowNode::Data* row = data->firstRow; row; row = row->nextRow)
+		{
+			for (TableCellNode::Data* cell = row->firstCell; cell; cell = cell->nextCell)
+			{
+				if (pass == 0 && cell->columnSpan > 1)
+					continue;
+				if (pass == 1 && cell->columnSpan == 1)
+					continue;
+
+				int contentWidth = GetCellContentWidth(layout, data, cell, availableWidth, maxConstrainedTableWidth);
+				if (contentWidth < 0)
+				{
+					return false;
+				}
+
+				int preferredWidth = (2 * data->cellPadding + contentWidth);
+				int explicitWidth = 0;
+				int explicitWidthPercentage = 0;
+
+				if (cell->explicitWidth.IsSet())
+				{
+					if (cell->explicitWidth.IsPercentage())
+					{
+						explicitWidthPercentage = cell->explicitWidth.Value();
+					}
+					else
+					{
+						explicitWidth = ((long)cell->explicitWidth.Value() * Platform::video->GetVideoModeInfo()->zoom) / 100;
+					}
+				}
+
+				if (preferredWidth > maxConstrainedTableWidth)
+				{
+					preferredWidth = maxConstrainedTableWidth;
+					layout.MarkWidthDependent();
+				}
+				if (explicitWidth > maxConstrainedTableWidth)
+				{
+					explicitWidth = maxConstrainedTableWidth;
+					layout.MarkWidthDependent();
+				}
+				
+				if (pass == 0)
+				{
+					if (data->columns[cell->columnIndex].preferredWidth < preferredWidth)
+					{
+						data->columns[cell->columnIndex].preferredWidth = preferredWidth;
+					}
+					if (data->columns[cell->columnIndex].explicitWidthPercentage < explicitWidthPercentage)
+					{
+						data->columns[cell->columnIndex].explicitWidthPercentage = explicitWidthPercentage;
+					}
+					if (data->columns[cell->columnIndex].explicitWidthPixels < explicitWidth)
+					{
+						data->columns[cell->columnIndex].explicitWidthPixels = explicitWidth;
+					}
+				}
+				else
+				{
+					int columnsPreferredWidth = data->cellSpacing * (cell->columnSpan - 1);
+					int columnsExplicitWidthPercentage = 0;
+					int columnsExplicitWidthPixels = 0;
+
+					for (int i = 0; i < cell->columnSpan; i++)
+					{
+						columnsPreferredWidth += data->columns[cell->columnIndex + i].preferredWidth;
+						columnsExplicitWidthPercentage += data->columns[cell->columnIndex + i].explicitWidthPercentage;
+						columnsExplicitWidthPixels += data->columns[cell->columnIndex + i].explicitWidthPixels;
+					}
+
+					if (columnsPreferredWidth < preferredWidth)
+					{
+						for (int i = 0; i < cell->columnSpan; i++)
+						{
+							data->columns[cell->columnIndex + i].preferredWidth += (preferredWidth - columnsPreferredWidth) / cell->columnSpan;
+						}
+					}
+					if (columnsExplicitWidthPercentage < explicitWidthPercentage)
+					{
+						for (int i = 0; i < cell->columnSpan; i++)
+						{
+							data->columns[cell->columnIndex + i].explicitWidthPercentage += (explicitWidthPercentage - columnsExplicitWidthPercentage) / cell->columnSpan;
+						}
+					}
+					if (columnsExplicitWidthPixels < explicitWidth)
+					{
+						for (int i = 0; i < cell->columnSpan; i++)
+						{
+							data->columns[cell->columnIndex + i].explicitWidthPixels += (explicitWidth - columnsExplicitWidthPixels) / cell->columnSpan;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	data->totalWidth = 0;
+	int totalCellSpacing = (data->numColumns + 1) * data->cellSpacing;
+
+	if (!data->explicitWidth.IsSet())
+	{
+		// Need to calculate the width of the table as it wasn't specified
+		int totalPreferredWidth = 0;
+		int maxAvailableWidthForCells = availableWidth - totalCellSpacing;
+
+		for (int i = 0; i < data->numColumns; i++)
+		{
+			if (data->columns[i].explicitWidthPixels)
+			{
+				data->columns[i].calculatedWidth = data->columns[i].explicitWidthPixels;
+			}
+			else if (data->columns[i].explicitWidthPercentage)
+			{
+				data->columns[i].calculatedWidth = 0;
+			}
+			else
+			{
+				data->columns[i].calculatedWidth = data->columns[i].preferredWidth;
+			}
+			totalPreferredWidth += data->columns[i].calculatedWidth;
+		}
+
+		// Enforce percentage constraints
+		for (int it = 0; it < data->numColumns; it++)
+		{
+			bool changesMade = false;
+
+			for (int i = 0; i < data->numColumns; i++)
+			{
+				if (data->columns[i].explicitWidthPercentage)
+				{
+					int desiredWidth = (data->columns[i].explicitWidthPercentage * totalPreferredWidth) / 100;
+
+					if (desiredWidth != data->columns[i].calculatedWidth)
+					{
+						totalPreferredWidth -= data->columns[i].calculatedWidth;
+						long z = data->columns[i].explicitWidthPercentage;
+						if (z >= 100)
+						{
+							data->columns[i].calculatedWidth = totalPreferredWidth;
+						}
+						else
+						{
+							data->columns[i].calculatedWidth = (z * totalPreferredWidth) / (100 - z);
+						}
+						totalPreferredWidth += data->columns[i].calculatedWidth;
+						changesMade = true;
+					}
+				}
+			}
+
+			if (!changesMade)
+				break;
+		}
+
+		if (totalPreferredWidth <= maxAvailableWidthForCells)
+		{
+			data->totalWidth = totalPreferredWidth + totalCellSpacing;
+			node->size.x = data->totalWidth;
+		}
+	}
+
+	if (data->explicitWidth.IsSet() || !data->totalWidth)
+	{
+		// Generate widths for columns based on a given table width
+		if (data->explicitWidth.IsSet())
+		{
+			data->totalWidth = layout.CalculateWidth(data->explicitWidth);
+		}
+		else
+		{
+			// Too wide for the available width so fill it
+			data->totalWidth = availableWidth;
+			layout.MarkWidthDependent();
+		}
+		node->size.x = data->totalWidth;
+
+		int maxAvailableWidthForCells = node->size.x - totalCellSpacing;
+		int widthRemaining = maxAvailableWidthForCells;
+		int totalUnsetWidth = 0;
+		int minUnsetWidth = 0;
+		minCellWidth = data->numColumns ? data->totalWidth / (data->numColumns * 2) : 0;
+
+		// First pass allocate widths to explicit pixels widths
+		for (int i = 0; i < data->numColumns; i++)
+		{
+			if (data->columns[i].explicitWidthPixels)
+			{
+				data->columns[i].calculatedWidth = data->columns[i].explicitWidthPixels;
+			}
+			if (data->columns[i].explicitWidthPercentage)
+			{
+				int calculatedWidth = (long)(data->columns[i].explicitWidthPercentage * maxAvailableWidthForCells) / 100;
+				if (calculatedWidth > data->columns[i].calculatedWidth)
+				{
+					data->columns[i].calculatedWidth = calculatedWidth;
+				}
+			}
+
+			if (data->columns[i].calculatedWidth)
+			{
+				widthRemaining -= data->columns[i].calculatedWidth;
+			}
+			else
+			{
+				totalUnsetWidth += data->columns[i].preferredWidth;
+
+				if(data->columns[i].preferredWidth)
+					minUnsetWidth += minCellWidth;
+			}
+		}
+
+		int totalCellsWidth = 0;
+
+		if (widthRemaining < minUnsetWidth)
+		{
+			int widthForSetCells = maxAvailableWidthForCells - minUnsetWidth;
+			int totalSetWidth = maxAvailableWidthForCells - widthRemaining;
+
+			// Explicit cell widths too large to fit in table, readjust
+			for (int i = 0; i < data->numColumns; i++)
+			{
+				if (!data->columns[i].calculatedWidth)
+				{
+					if (data->columns[i].preferredWidth)
+						data->columns[i].calculatedWidth = minCellWidth;
+				}
+				else if(RESCALE_TO_FIT_SCREEN_WIDTH)
+				{
+					data->columns[i].calculatedWidth = ((long)widthForSetCells * data->columns[i].calculatedWidth) / totalSetWidth;
+				}
+				totalCellsWidth += data->columns[i].calculatedWidth;
+			}
+		}
+		else
+		{
+			for (int i = 0; i < data->numColumns; i++)
+			{
+				if (!data->columns[i].calculatedWidth && totalUnsetWidth)
+				{
+					data->columns[i].calculatedWidth = ((long)widthRemaining * data->columns[i].preferredWidth) / totalUnsetWidth;
+				}
+				totalCellsWidth += data->columns[i].calculatedWidth;
+			}
+		}
+
+		if (totalCellsWidth < maxAvailableWidthForCells && data->numColumns > 0)
+		{
+			data->columns[data->numColumns - 1].calculatedWidth += maxAvailableWidthForCells - totalCellsWidth;
+		}
+	}
+
+	return true;
+}
+
+// Padding to apply to the left of the table so that it is aligned within the available width
+static int CalculateAlignmentPadding(Layout& layout, Node* node, int availableWidth)
+{
+	TableNode::Data* data = static_cast<TableNode::Data*>(node);
+
+	if (node->GetStyle().alignment != ElementAlignment::Left)
+	{
+		layout.MarkWidthDependent();
+	}
+
+	if (data->totalWidth < availableWidth)
+	{
+		if (node->GetStyle().alignment == ElementAlignment::Center)
+		{
+			return (availableWidth - data->totalWidth) / 2;
+		}
+		else if (node->GetStyle().alignment == ElementAlignment::Right)
+		{
+			return availableWidth - data->totalWidth;
+		}
+	}
+	return 0;
+}
+
 void TableNode::BeginLayoutContext(Layout& layout, Node* node)
 {
 	TableNode::Data* data = static_cast<TableNode::Data*>(node);
@@ -67,13 +413,37 @@ void TableNode::BeginLayoutContext(Layout& layout, Node* node)
 
 	if (data->state == Data::FinishedLayout)
 	{
-		//if (availableWidth != data->lastAvailableWidth)
+		bool canReuseCellWidths = true;
+#ifdef MWBENCH
+		canReuseCellWidths = reuseTableCellWidths;
+#endif
+
+		if (canReuseCellWidths && CalculateColumnWidths(layout, node))
+		{
+			// The column widths could be solved from the cached cell widths, so the table is
+			// only laid out once
+			data->state = Data::ReusingLayout;
+		}
+		else
 		{
 			data->state = Data::GeneratingLayout;
 		}
 	}
 
-	data->lastAvailableWidth = availableWidth;
+	if (data->state == Data::ReusingLayout || data->state == Data::FinalisingLayout)
+	{
+		int alignmentPadding = CalculateAlignmentPadding(layout, node, availableWidth);
+		if (alignmentPadding)
+		{
+			layout.PadHorizontal(alignmentPadding, 0);
+			node->anchor = layout.Cursor();
+		}
+	}
+
+	if (data->IsGeneratingLayout())
+	{
+		data->lastAvailableWidth = availableWidth;
+	}
 
 	if (!data->IsGeneratingLayout())
 	{
@@ -167,328 +537,34 @@ void TableNode::EndLayoutContext(Layout& layout, Node* node)
 				}
 				rowIndex++;
 			}
-		}
-
-		int minCellWidth = 16;
-
-		for (int n = 0; n < data->numColumns; n++)
-		{
-			data->columns[n].Clear();
-			//data->columns[n].preferredWidth = minCellWidth;
-		}
-
-		// Cull unused columns
-		for (int n = data->numColumns - 1; n >= 0; n--)
-		{
-			bool isUsed = false;
 
-			for (TableRowNode::Data* row = data->firstRow; row && !isUsed; row = row->nextRow)
-			{
-				for (TableCellNode::Data* cell = row->firstCell; cell && !isUsed; cell = cell->nextCell)
-				{
-					if (cell->columnIndex == n)
-					{
-						isUsed = true;
-					}
-				}
-			}
-
-			if (isUsed)
-			{
-				break;
-			}
-			else
-			{
-				data->numColumns--;
-			}
-		}
-
-		int maxConstrainedTableWidth = layout.MaxAvailableWidth();
-		if (data->explicitWidth.IsSet())
-		{
-			maxConstrainedTableWidth = layout.CalculateWidth(data->explicitWidth);
-		}
-
-		// Find out preferred column widths in two passes:
-		// - First pass, check with cells of column span = 1
-		// - Second pass for cells of column span > 1
-		for (int pass = 0; pass < 2; pass++)
-		{
+			// Cull trailing columns that no cell starts in
+			int lastUsedColumnIndex = -1;
 			for (TableRowNode::Data* row = data->firstRow; row; row = row->nextRow)
 			{
 				for (TableCellNode::Data* cell = row->firstCell; cell; cell = cell->nextCell)
 				{
-					if (pass == 0 && cell->columnSpan > 1)
-						continue;
-					if (pass == 1 && cell->columnSpan == 1)
-						continue;
-
-					int preferredWidth = (2 * data->cellPadding + cell->size.x);
-					int explicitWidth = 0;
-					int explicitWidthPercentage = 0;
-
-					if (cell->explicitWidth.IsSet())
+					if (cell->columnIndex > lastUsedColumnIndex)
 					{
-						if (cell->explicitWidth.IsPercentage())
-						{
-							explicitWidthPercentage = cell->explicitWidth.Value();
-						}
-						else
-						{
-							explicitWidth = ((long)cell->explicitWidth.Value() * Platform::video->GetVideoModeInfo()->zoom) / 100;
-						}
-					}
-
-					if (preferredWidth > maxConstrainedTableWidth)
-					{
-						preferredWidth = maxConstrainedTableWidth;
-					}
-					if (explicitWidth > maxConstrainedTableWidth)
-					{
-						explicitWidth = maxConstrainedTableWidth;
-					}
-					
-					if (pass == 0)
-					{
-						if (data->columns[cell->columnIndex].preferredWidth < preferredWidth)
-						{
-							data->columns[cell->columnIndex].preferredWidth = preferredWidth;
-						}
-						if (data->columns[cell->columnIndex].explicitWidthPercentage < explicitWidthPercentage)
-						{
-							data->columns[cell->columnIndex].explicitWidthPercentage = explicitWidthPercentage;
-						}
-						if (data->columns[cell->columnIndex].explicitWidthPixels < explicitWidth)
-						{
-							data->columns[cell->columnIndex].explicitWidthPixels = explicitWidth;
-						}
-					}
-					else
-					{
-						int columnsPreferredWidth = data->cellSpacing * (cell->columnSpan - 1);
-						int columnsExplicitWidthPercentage = 0;
-						int columnsExplicitWidthPixels = 0;
-
-						for (int i = 0; i < cell->columnSpan; i++)
-						{
-							columnsPreferredWidth += data->columns[cell->columnIndex + i].preferredWidth;
-							columnsExplicitWidthPercentage += data->columns[cell->columnIndex + i].explicitWidthPercentage;
-							columnsExplicitWidthPixels += data->columns[cell->columnIndex + i].explicitWidthPixels;
-						}
-
-						if (columnsPreferredWidth < preferredWidth)
-						{
-							for (int i = 0; i < cell->columnSpan; i++)
-							{
-								data->columns[cell->columnIndex + i].preferredWidth += (preferredWidth - columnsPreferredWidth) / cell->columnSpan;
-							}
-						}
-						if (columnsExplicitWidthPercentage < explicitWidthPercentage)
-						{
-							for (int i = 0; i < cell->columnSpan; i++)
-							{
-								data->columns[cell->columnIndex + i].explicitWidthPercentage += (explicitWidthPercentage - columnsExplicitWidthPercentage) / cell->columnSpan;
-							}
-						}
-						if (columnsExplicitWidthPixels < explicitWidth)
-						{
-							for (int i = 0; i < cell->columnSpan; i++)
-							{
-								data->columns[cell->columnIndex + i].explicitWidthPixels += (explicitWidth - columnsExplicitWidthPixels) / cell->columnSpan;
-							}
-						}
+						lastUsedColumnIndex = cell->columnIndex;
 					}
 				}
 			}
+			data->numColumns = lastUsedColumnIndex + 1;
 		}
 
-		data->totalWidth = 0;
-		int totalCellSpacing = (data->numColumns + 1) * data->cellSpacing;
-
-		if (!data->explicitWidth.IsSet())
-		{
-			// Need to calculate the width of the table as it wasn't specified
-			int totalPreferredWidth = 0;
-			int maxAvailableWidthForCells = layout.MaxAvailableWidth() - totalCellSpacing;
-			int widthRemaining = maxAvailableWidthForCells;
-
-			for (int i = 0; i < data->numColumns; i++)
-			{
-				if (data->columns[i].explicitWidthPixels)
-				{
-					data->columns[i].calculatedWidth = data->columns[i].explicitWidthPixels;
-				}
-				else if (data->columns[i].explicitWidthPercentage)
-				{
-					data->columns[i].calculatedWidth = 0;
-				}
-				else
-				{
-					data->columns[i].calculatedWidth = data->columns[i].preferredWidth;
-				}
-				totalPreferredWidth += data->columns[i].calculatedWidth;
-			}
-
-			// Enforce percentage constraints
-			for (int it = 0; it < data->numColumns; it++)
-			{
-				bool changesMade = false;
-
-				for (int i = 0; i < data->numColumns; i++)
-				{
-					if (data->columns[i].explicitWidthPercentage)
-					{
-						int desiredWidth = (data->columns[i].explicitWidthPercentage * totalPreferredWidth) / 100;
-
-						if (desiredWidth != data->columns[i].calculatedWidth)
-						{
-							totalPreferredWidth -= data->columns[i].calculatedWidth;
-							long z = data->columns[i].explicitWidthPercentage;
-							if (z >= 100)
-							{
-								data->columns[i].calculatedWidth = totalPreferredWidth;
-							}
-							else
-							{
-								data->columns[i].calculatedWidth = (z * totalPreferredWidth) / (100 - z);
-							}
-							totalPreferredWidth += data->columns[i].calculatedWidth;
-							changesMade = true;
-						}
-					}
-				}
-
-				if (!changesMade)
-					break;
-			}
-
-			if (totalPreferredWidth <= maxAvailableWidthForCells)
-			{
-				data->totalWidth = totalPreferredWidth + totalCellSpacing;
-				node->size.x = data->totalWidth;
-			}
-		}
-
-		if (data->explicitWidth.IsSet() || !data->totalWidth)
-		{
-			// Generate widths for columns based on a given table width
-			if (data->explicitWidth.IsSet())
-			{
-				data->totalWidth = layout.CalculateWidth(data->explicitWidth);
-			}
-			else
-			{
-				data->totalWidth = layout.MaxAvailableWidth();
-			}
-			node->size.x = data->totalWidth;
-
-			int maxAvailableWidthForCells = node->size.x - totalCellSpacing;
-			int widthRemaining = maxAvailableWidthForCells;
-			int totalUnsetWidth = 0;
-			int minUnsetWidth = 0;
-			minCellWidth = data->numColumns ? data->totalWidth / (data->numColumns * 2) : 0;
-
-			// First pass allocate widths to explicit pixels widths
-			for (int i = 0; i < data->numColumns; i++)
-			{
-				if (data->columns[i].explicitWidthPixels)
-				{
-					data->columns[i].calculatedWidth = data->columns[i].explicitWidthPixels;
-				}
-				if (data->columns[i].explicitWidthPercentage)
-				{
-					int calculatedWidth = (long)(data->columns[i].explicitWidthPercentage * maxAvailableWidthForCells) / 100;
-					if (calculatedWidth > data->columns[i].calculatedWidth)
-					{
-						data->columns[i].calculatedWidth = calculatedWidth;
-					}
-				}
-
-				if (data->columns[i].calculatedWidth)
-				{
-					widthRemaining -= data->columns[i].calculatedWidth;
-				}
-				else
-				{
-					totalUnsetWidth += data->columns[i].preferredWidth;
-
-					if(data->columns[i].preferredWidth)
-						minUnsetWidth += minCellWidth;
-				}
-			}
-
-			int totalCellsWidth = 0;
-
-			if (widthRemaining < minUnsetWidth)
-			{
-				int widthForSetCells = maxAvailableWidthForCells - minUnsetWidth;
-				int totalSetWidth = maxAvailableWidthForCells - widthRemaining;
-
-				// Explicit cell widths too large to fit in table, readjust
-				for (int i = 0; i < data->numColumns; i++)
-				{
-					if (!data->columns[i].calculatedWidth)
-					{
-						if (data->columns[i].preferredWidth)
-							data->columns[i].calculatedWidth = minCellWidth;
-					}
-					else if(RESCALE_TO_FIT_SCREEN_WIDTH)
-					{
-						data->columns[i].calculatedWidth = ((long)widthForSetCells * data->columns[i].calculatedWidth) / totalSetWidth;
-					}
-					totalCellsWidth += data->columns[i].calculatedWidth;
-				}
-			}
-			else
-			{
-				for (int i = 0; i < data->numColumns; i++)
-				{
-					if (!data->columns[i].calculatedWidth && totalUnsetWidth)
-					{
-						data->columns[i].calculatedWidth = ((long)widthRemaining * data->columns[i].preferredWidth) / totalUnsetWidth;
-					}
-					totalCellsWidth += data->columns[i].calculatedWidth;
-				}
-			}
-
-			if (totalCellsWidth < maxAvailableWidthForCells && data->numColumns > 0)
-			{
-				data->columns[data->numColumns - 1].calculatedWidth += maxAvailableWidthForCells - totalCellsWidth;
-			}
-		}
-
-		layout.PushCursor();
-		layout.PushLayout();
-
-		int available = layout.AvailableWidth();
-		if (data->totalWidth < available)
-		{
-			int alignmentPadding = 0;
-
-			if (node->GetStyle().alignment == ElementAlignment::Center)
-			{
-				alignmentPadding = (available - data->totalWidth) / 2;
-			}
-			else if (node->GetStyle().alignment == ElementAlignment::Right)
-			{
-				alignmentPadding = (available - data->totalWidth);
-			}
-			if (alignmentPadding)
-			{
-				layout.PadHorizontal(alignmentPadding, 0);
-				node->anchor = layout.Cursor();
-			}
-		}
+		CalculateColumnWidths(layout, node);
 
+		// The table is laid out again with the solved column widths by the same walk that laid
+		// out its contents, so that a big table doesn't hold up input while it is finalised
 		data->state = Data::FinalisingLayout;
-		layout.RecalculateLayoutForNode(node);
-
-		layout.PopLayout();
-		layout.PopCursor();
-
-		data->state = Data::FinishedLayout;
+		layout.tableDepth--;
+		layout.RestartNode(node);
+		return;
 	}
 
+	data->state = Data::FinishedLayout;
+
 	for (TableRowNode::Data* row = data->firstRow; row; row = row->nextRow)
 	{
 		if (!row->nextRow)
@@ -671,6 +747,10 @@ void TableCellNode::BeginLayoutContext(Layout& layout, Node* node)
 
 	if (tableData)
 	{
+		if (tableData->IsGeneratingLayout())
+		{
+			layout.BeginMeasure();
+		}
 		layout.PadVertical(tableData->cellPadding);
 	}
 }
@@ -680,21 +760,48 @@ void TableCellNode::EndLayoutContext(Layout& layout, Node* node)
 	TableCellNode::Data* data = static_cast<TableCellNode::Data*>(node);
 
 	TableNode::Data* tableData = node->FindParentDataOfType<TableNode::Data>(Node::Table);
-	TableRowNode::Data* rowData = node->FindParentDataOfType<TableRowNode::Data>(Node::TableRow);
+	Rect rect;
 
 	if (tableData)
 	{
-		Rect rect;
-		node->CalculateEncapsulatingRect(rect);
+		if (node->firstChild)
+		{
+			node->CalculateEncapsulatingRect(rect);
+		}
+		else
+		{
+			// The encapsulating rect of an empty cell would be its own size from the last layout,
+			// so it would grow each time the table is laid out
+			rect.x = layout.GetParams().marginLeft;
+			rect.y = node->anchor.y + tableData->cellPadding;
+			rect.width = rect.height = 0;
+		}
 		node->size.y = rect.y + rect.height + tableData->cellPadding - node->anchor.y;
 
 		if (tableData->IsGeneratingLayout())
 		{
 			node->size.x = rect.width;
+			data->contentWidth = rect.width;
 		}
 	}
 
 	layout.BreakNewLine();
+
+	if (tableData && tableData->IsGeneratingLayout())
+	{
+		ContentMeasure measure = layout.EndMeasure();
+		data->minContentWidth = measure.minContentWidth;
+		if (measure.isWidthDependent)
+		{
+			data->maxContentWidth = CONTENT_WIDTH_UNKNOWN;
+		}
+		else
+		{
+			// Nothing wrapped, so the contents fit in any width that reaches their right edge
+			data->maxContentWidth = rect.x + rect.width - layout.GetParams().marginLeft;
+		}
+	}
+
 	layout.PopCursor();
 	layout.PopLayout();
 
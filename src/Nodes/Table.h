@@ -4,13 +4,16 @@
 #include "../Node.h"
 #include "../Colour.h"
 
+// Maximum content width of a cell whose layout changed with the width it was measured at
+#define CONTENT_WIDTH_UNKNOWN 0x7fff
+
 class TableCellNode : public NodeHandler
 {
 public:
 	class Data : public Node
 	{
 	public:
-		Data(bool inIsHeader) : Node(Node::TableCell), isHeader(inIsHeader), columnIndex(0), rowIndex(0), columnSpan(1), rowSpan(1), bgColour(TRANSPARENT_COLOUR_VALUE), nextCell(nullptr) {}
+		Data(bool inIsHeader) : Node(Node::TableCell), isHeader(inIsHeader), columnIndex(0), rowIndex(0), columnSpan(1), rowSpan(1), bgColour(TRANSPARENT_COLOUR_VALUE), nextCell(nullptr), contentWidth(0), minContentWidth(0), maxContentWidth(0) {}
 		bool isHeader;
 		int columnIndex;
 		int rowIndex;
@@ -19,6 +22,9 @@ public:
 		uint8_t bgColour;
 		TableCellNode::Data* nextCell;
 		ExplicitDimension explicitWidth;
+		int contentWidth;			// Width of the contents when last measured by the table, used for sizing columns
+		int minContentWidth;		// Widest part of the contents that can't be broken across lines
+		int maxContentWidth;		// Width the contents need to be laid out without wrapping
 	};
 
 	static TableCellNode::Data* Construct(Allocator& allocator, bool isHeader);
@@ -71,7 +77,8 @@ public:
 		{
 			GeneratingLayout,
 			FinalisingLayout,
-			FinishedLayout
+			FinishedLayout,
+			ReusingLayout			// Laying out with column widths solved from the cached cell widths
 		};
 
 		Data() : Node(Node::Table), state(GeneratingLayout), numColumns(0), numRows(0), cellSpacing(2), cellPadding(2), border(0), columns(nullptr), firstRow(nullptr), cells(nullptr), bgColour(TRANSPARENT_COLOUR_VALUE), lastAvailableWidth(-1) {}
@@ -90,7 +97,7 @@ public:
 		TableRowNode::Data* firstRow;
 		TableCellNode::Data** cells;
 		uint8_t bgColour;
-		int lastAvailableWidth;
+		int lastAvailableWidth;		// Width that the cells were last measured at
 		ExplicitDimension explicitWidth;
 	};
 
@@ -101,4 +108,9 @@ public:
 
 };
 
+#ifdef MWBENCH
+// Cleared by the benchmark to check that tables lay out the same when their cells are always measured again
+extern bool reuseTableCellWidths;
+#endif
+
 #endif
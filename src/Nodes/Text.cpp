@@ -19,6 +19,17 @@ TextElement::Data* TextElement::Construct(Allocator& allocator, const char* text
 	return nullptr;
 }
 
+// Takes ownership of text that has already been written into block storage
+TextElement::Data* TextElement::Construct(Allocator& allocator, MemBlockHandle& textHandle)
+{
+	if (textHandle.IsAllocated())
+	{
+		return allocator.Alloc<TextElement::Data>(textHandle);
+	}
+
+	return nullptr;
+}
+
 void TextElement::Draw(DrawContext& context, Node* node)
 {
 	TextElement::Data* data = static_cast<TextElement::Data*>(node);
@@ -53,22 +64,244 @@ void TextElement::Draw(DrawContext& context, Node* node)
 }
 
 
+// Non breaking spaces are drawn as normal spaces
+static void ReplaceNonBreakingSpaces(TextElement::Data* data, char* text)
+{
+	bool hasModified = false;
+	for (char* p = text; *p; p++)
+	{
+		if (*p == '\x1f')
+		{
+			*p = ' ';
+			hasModified = true;
+		}
+	}
+	if (hasModified)
+	{
+		data->text.Commit();
+	}
+}
+
+// Splits the text into word runs and measures each of them. If they can't be allocated
+// then the runs are measured each time the text is laid out instead
+static void BuildWordRuns(TextElement::Data* data, char* text, Font* font, FontStyle::Type fontStyle)
+{
+	long numRuns = 1;
+	int runLength = 0;
+
+	for (const char* p = text; *p; p++)
+	{
+		if (runLength == MAX_TEXT_WORD_RUN_LENGTH)
+		{
+			numRuns++;
+			runLength = 0;
+		}
+
+		if (*p == ' ' || *p == '\t')
+		{
+			numRuns++;
+			runLength = 0;
+		}
+		else
+		{
+			runLength++;
+		}
+	}
+
+	if (numRuns * sizeof(TextWordRun) >= CHUNK_DATA_SIZE)
+	{
+		return;
+	}
+
+	TextWordRun* runs = (TextWordRun*) MemoryManager::pageAllocator.Allocate(numRuns * sizeof(TextWordRun));
+	if (!runs)
+	{
+		return;
+	}
+
+	font->CalculateWordWidths(text, runs, (int) numRuns, fontStyle);
+
+	// Now that the runs are known the non breaking spaces can be replaced
+	ReplaceNonBreakingSpaces(data, text);
+
+	data->wordRuns = runs;
+}
+
+// Fills lines with text, emitting a SubTextElement for each line if the text needs wrapping
+class TextLineBreaker
+{
+public:
+	TextLineBreaker(Layout& inLayout, Node* inNode, int inLineHeight)
+		: width(0), layout(inLayout), node(inNode), lineHeight(inLineHeight)
+		, startIndex(0), lastBreakPoint(0), lastBreakPointWidth(0)
+		, subTextNode(inNode->firstChild.Get()), lastSubTextNode(nullptr)
+	{
+	}
+
+	// Returns false once the text has been completely laid out
+	bool AddChar(int charIndex, int glyphWidth, bool isBreakPoint, bool isEnd);
+
+	int width;
+
+private:
+	bool EmitLine(int emitStartPosition, int emitLength, int emitWidth);
+
+	Layout& layout;
+	Node* node;
+	int lineHeight;
+	int startIndex;
+	int lastBreakPoint;
+	int lastBreakPointWidth;
+	Node* subTextNode;
+	Node* lastSubTextNode;
+};
+
+bool TextLineBreaker::AddChar(int charIndex, int glyphWidth, bool isBreakPoint, bool isEnd)
+{
+	if (isBreakPoint)
+	{
+		lastBreakPoint = charIndex;
+		lastBreakPointWidth = width;
+	}
+
+	width += glyphWidth;
+
+	bool cannotFit = width > layout.AvailableWidth();
+
+	if (cannotFit)
+	{
+		layout.MarkWidthDependent();
+	}
+
+	if (cannotFit && !lastBreakPoint && layout.AvailableWidth() < layout.MaxAvailableWidth())
+	{
+		// Nothing could fit on the line before the break, just add a line break
+		layout.BreakNewLine();
+		cannotFit = width > layout.AvailableWidth();
+	}
+
+	if (!cannotFit && !isEnd)
+	{
+		return true;
+	}
+
+	// Needs a line break
+	int emitLength;
+	int emitWidth;
+	int nextIndex;
+
+	if (isEnd && !cannotFit)
+	{
+		// End of the line so just emit everything
+		emitLength = charIndex + 1 - startIndex;
+		emitWidth = width;
+		nextIndex = -1;
+
+		if (!node->firstChild)
+		{
+			// No line breaks so don't create sub text nodes
+			node->anchor = layout.GetCursor(lineHeight);
+			node->size.x = emitWidth;
+			node->size.y = lineHeight;
+
+			layout.ProgressCursor(node, emitWidth, lineHeight);
+			return false;
+		}
+	}
+	else if (lastBreakPoint)
+	{
+		// There was a space or tab that we can break at
+		emitLength = lastBreakPoint - startIndex;
+		emitWidth = lastBreakPointWidth;
+		nextIndex = lastBreakPoint + 1;
+	}
+	else
+	{
+		// Need to break in the middle of a word
+		emitLength = charIndex - startIndex;
+		emitWidth = width - glyphWidth;
+		nextIndex = charIndex;
+	}
+
+	if (!EmitLine(startIndex, emitLength, emitWidth))
+	{
+		return false;
+	}
+
+	startIndex = nextIndex;
+	width -= emitWidth;
+
+	if (isEnd)
+	{
+		if (cannotFit && nextIndex <= charIndex)
+		{
+			// The end of the text didn't fit so it goes on a line of its own
+			layout.BreakNewLine();
+			EmitLine(nextIndex, charIndex + 1 - nextIndex, width);
+		}
+		return false;
+	}
+
+	lastBreakPoint = 0;
+	lastBreakPointWidth = 0;
+
+	layout.BreakNewLine();
+	return true;
+}
+
+bool TextLineBreaker::EmitLine(int emitStartPosition, int emitLength, int emitWidth)
+{
+	if (!subTextNode)
+	{
+		subTextNode = SubTextElement::Construct(MemoryManager::pageAllocator, emitStartPosition, emitLength);
+
+		if (!subTextNode)
+			return false;
+
+		node->AddChild(subTextNode, lastSubTextNode);
+	}
+	else
+	{
+		SubTextElement::Data* subTextData = static_cast<SubTextElement::Data*>(subTextNode);
+		subTextData->startIndex = emitStartPosition;
+		subTextData->length = emitLength;
+	}
+
+	subTextNode->anchor = layout.GetCursor(lineHeight);
+	subTextNode->size.x = emitWidth;
+	subTextNode->size.y = lineHeight;
+
+	layout.ProgressCursor(subTextNode, emitWidth, lineHeight);
+	lastSubTextNode = subTextNode;
+	subTextNode = subTextNode->next.Get();
+	return true;
+}
+
 void TextElement::GenerateLayout(Layout& layout, Node* node)
 {
 	TextElement::Data* data = static_cast<TextElement::Data*>(node);
 	Font* font = node->GetStyleFont();
 	int lineHeight = font->glyphHeight;
 
-#if 1
-	// TODO: optimisation
 	if (data->lastAvailableWidth != -1)
 	{
 		// We must be regenerating this text element, see if we can just shuffle position rather than
 		// completely regenerating the whole layout
 		if (data->lastAvailableWidth == layout.AvailableWidth())
 		{
+			Node* firstLine = node->firstChild ? node->firstChild.Get() : node;
+			if (firstLine->size.x > layout.AvailableWidth() && layout.AvailableWidth() < layout.MaxAvailableWidth())
+			{
+				// The first word didn't fit last time either so it was moved on to a new line
+				layout.BreakNewLine();
+				layout.MarkWidthDependent();
+			}
+
 			if (node->firstChild)
 			{
+				// The lines were wrapped at this width
+				layout.MarkWidthDependent();
+
 				for (Node* child = node->firstChild.Get(); child; child = child->next.Get())
 				{
 					child->anchor = layout.GetCursor(lineHeight);
@@ -90,8 +323,6 @@ void TextElement::GenerateLayout(Layout& layout, Node* node)
 	}
 
 	data->lastAvailableWidth = layout.AvailableWidth();
-#endif
-	
 
 	// Clear out SubTextElement children if we are regenerating the layout
 	for (Node* child = node->firstChild.Get(); child; child = child->next.Get())
@@ -106,127 +337,102 @@ void TextElement::GenerateLayout(Layout& layout, Node* node)
 	node->size.Clear();
 
 	char* text = data->text.Get<char*>();
-	int charIndex = 0;
-	int startIndex = 0;
-	int lastBreakPoint = 0;
-	int lastBreakPointWidth = 0;
-	int width = 0;
-	Node* subTextNode = node->firstChild.Get();
-	bool hasModified = false;
+	FontStyle::Type fontStyle = node->GetStyle().fontStyle;
 
-	for(charIndex = 0; ; charIndex++)
+	bool hasNonBreakingSpaces = !data->wordRuns && strchr(text, '\x1f');
+	if (hasNonBreakingSpaces)
 	{
-		char c = text[charIndex];
-		bool isEnd = text[charIndex + 1] == 0;
+		// The non breaking spaces get replaced with normal spaces for drawing, so the
+		// runs are needed to remember where they were
+		BuildWordRuns(data, text, font, fontStyle);
+	}
 
-		if (c == ' ' || c == '\t')
-		{
-			lastBreakPoint = charIndex;
-			lastBreakPointWidth = width;
-		}
+	// Whole runs are added to the line while they fit. Only a run that might not fit
+	// is stepped through a character at a time, to find where the line breaks
+	TextLineBreaker lineBreaker(layout, node, lineHeight);
+	TextWordRun* nextRun = data->wordRuns;
+	TextWordRun measuredRun;
+	int charIndex = 0;
 
-		if (c == '\x1f')
+	for (;;)
+	{
+		TextWordRun* run = nextRun;
+		if (run)
 		{
-			// Non breaking space
-			text[charIndex] = ' ';
-			hasModified = true;
+			nextRun++;
 		}
-
-		int glyphWidth = font->GetGlyphWidth(c, node->GetStyle().fontStyle);
-		width += glyphWidth;
-
-		bool cannotFit = width > layout.AvailableWidth();
-
-		if (cannotFit && !lastBreakPoint && layout.AvailableWidth() < layout.MaxAvailableWidth())
+		else
 		{
-			// Nothing could fit on the line before the break, just add a line break
-			layout.BreakNewLine();
-			cannotFit = width > layout.AvailableWidth();
+			font->CalculateWordWidths(text + charIndex, &measuredRun, 1, fontStyle);
+			run = &measuredRun;
 		}
 
-		if (cannotFit || isEnd)
-		{
-			// Needs a line break
+		int runEnd = charIndex + run->length;
+		bool isLastRun = text[runEnd] == 0;
 
-			int emitStartPosition = startIndex;
-			int emitLength;
-			int emitWidth;
-			int nextIndex;
-
-			if (isEnd && !cannotFit)
+		if (run->length)
+		{
+			if (run->width <= layout.MaxAvailableWidth())
 			{
-				// End of the line so just emit everything
-				emitLength = charIndex + 1 - emitStartPosition;
-				emitWidth = width;
-				nextIndex = -1;
+				// Runs wider than a whole line get split so they aren't counted
+				layout.AddUnbreakableWidth(run->width);
+			}
 
-				if (!node->firstChild)
+			if (lineBreaker.width + run->width <= layout.AvailableWidth())
+			{
+				lineBreaker.width += run->width;
+				if (isLastRun)
 				{
-					// No line breaks so don't create sub text nodes
-					node->anchor = layout.GetCursor(lineHeight);
-					node->size.x = emitWidth;
-					node->size.y = lineHeight;
-
-					layout.ProgressCursor(node, emitWidth, lineHeight);
+					lineBreaker.AddChar(runEnd - 1, 0, false, true);
 					break;
 				}
 			}
-			else if (lastBreakPoint)
-			{
-				// There was a space or tab that we can break at
-				emitLength = lastBreakPoint - emitStartPosition;
-				emitWidth = lastBreakPointWidth;
-				nextIndex = lastBreakPoint + 1;
-			}
 			else
 			{
-				// Need to break in the middle of a word
-				emitLength = charIndex - emitStartPosition;
-				emitWidth = width - glyphWidth;
-				nextIndex = charIndex;
-			}
-			
-			if (!subTextNode)
-			{
-				subTextNode = SubTextElement::Construct(MemoryManager::pageAllocator, emitStartPosition, emitLength);
-
-				if (!subTextNode)
+				bool isLaidOut = false;
+				for (int n = charIndex; n < runEnd && !isLaidOut; n++)
+				{
+					char c = text[n];
+					isLaidOut = !lineBreaker.AddChar(n, font->GetGlyphWidth(c == '\x1f' ? ' ' : c, fontStyle), false, text[n + 1] == 0);
+				}
+				if (isLaidOut)
+				{
 					break;
-
-				node->AddChild(subTextNode);
-			}
-			else
-			{
-				SubTextElement::Data* subTextData = static_cast<SubTextElement::Data*>(subTextNode);
-				subTextData->startIndex = emitStartPosition;
-				subTextData->length = emitLength;
+				}
 			}
+		}
 
-			subTextNode->anchor = layout.GetCursor(lineHeight);
-			subTextNode->size.x = emitWidth;
-			subTextNode->size.y = lineHeight;
-
-			startIndex = nextIndex;
-			width -= emitWidth;
-
-			layout.ProgressCursor(subTextNode, emitWidth, lineHeight);
-			subTextNode = subTextNode->next.Get();
-
-			if (isEnd)
-			{
-				break;
-			}
+		charIndex = runEnd;
 
-			lastBreakPoint = 0;
-			lastBreakPointWidth = 0;
+		if (isLastRun)
+		{
+			break;
+		}
+		if (run->length == MAX_TEXT_WORD_RUN_LENGTH)
+		{
+			// Long run that was split without a break character
+			continue;
+		}
 
-			layout.BreakNewLine();
+		if (!lineBreaker.AddChar(charIndex, font->GetGlyphWidth(text[charIndex], fontStyle), true, text[charIndex + 1] == 0))
+		{
+			break;
 		}
+		charIndex++;
 	}
 
-	if (hasModified)
+	if (!data->wordRuns && node->firstChild)
 	{
-		data->text.Commit();
+		// Text that wraps will be wrapped again whenever the available width changes, so keep the
+		// measurements. Text that fits on one line is cheap enough to measure each time
+		BuildWordRuns(data, data->text.Get<char*>(), font, fontStyle);
+	}
+
+	if (hasNonBreakingSpaces && !data->wordRuns)
+	{
+		// The runs couldn't be built so the non breaking spaces are replaced anyway, so that they
+		// aren't drawn as control characters. They can be wrapped at if the text is laid out again
+		ReplaceNonBreakingSpaces(data, data->text.Get<char*>());
 	}
 }
 
@@ -2,6 +2,7 @@
 
 #include "../Node.h"
 #include "../Memory/MemBlock.h"
+#include "../Font.h"
 
 class TextElement : public NodeHandler
 {
@@ -9,12 +10,14 @@ public:
 	class Data : public Node
 	{
 	public:
-		Data(MemBlockHandle& inText) : Node(Node::Text), text(inText), lastAvailableWidth(-1) {}
+		Data(MemBlockHandle& inText) : Node(Node::Text), text(inText), lastAvailableWidth(-1), wordRuns(nullptr) {}
 		MemBlockHandle text;
 		int lastAvailableWidth;
+		TextWordRun* wordRuns;		// Measured on first layout so that re-wrapping doesn't measure every character
 	};
 	
 	static TextElement::Data* Construct(Allocator& allocator, const char* text);
+	static TextElement::Data* Construct(Allocator& allocator, MemBlockHandle& textHandle);
 	virtual void GenerateLayout(Layout& layout, Node* node) override;
 	virtual void Draw(DrawContext& context, Node* element) override;
 };
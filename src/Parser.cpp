@@ -41,36 +41,61 @@ HTMLParser::HTMLParser(Page& inPage)
 , contextStack(MemoryManager::pageAllocator)
 , contextStackSize(0)
 , parseState(ParseText)
+, textBuffer(fixedTextBuffer)
 , textBufferSize(0)
-, parsingUnicode(false)
+, textBufferCapacity(sizeof(fixedTextBuffer))
+, spareTextRunSize(0)
+, contentTypeString(NULL)
+, contentTypeCapacity(0)
+, utf8State(UTF8_ACCEPT)
 , preformatted(0)
 {
+	InitTextCharClasses();
+}
+
+uint8_t HTMLParser::textCharClass[256];
+
+void HTMLParser::InitTextCharClasses()
+{
+	// Printable ASCII can be copied straight into the text buffer. Anything that changes
+	// the parse state, needs decoding or needs white space collapsing goes via ParseChar
+	for (int n = 0; n < 256; n++)
+	{
+		if (n > ' ' && n < 127 && n != '<' && n != '&')
+		{
+			textCharClass[n] = TextChar_Plain;
+		}
+		else if (n == ' ' || n == '\t' || n == '\n' || n == '\r')
+		{
+			textCharClass[n] = TextChar_WhiteSpace;
+		}
+		else
+		{
+			textCharClass[n] = TextChar_Special;
+		}
+	}
 }
 
 void HTMLParser::Reset()
 {
 	parseState = ParseText;
+	textRun = MemBlockHandle();
+	spareTextRun = MemBlockHandle();
+	spareTextRunSize = 0;
+	contentTypeString = NULL;
+	contentTypeCapacity = 0;
+	textBuffer = fixedTextBuffer;
+	textBufferCapacity = sizeof(fixedTextBuffer);
 	textBufferSize = 0;
 	preformatted = 0;
 	SetTextEncoding(TextEncoding::UTF8);
 
 	contextStack.Reset();
 	contextStackSize = -1;
+	memset(openTagCount, 0, sizeof(openTagCount));
 	PushContext(page.GetRootNode(), nullptr);
 }
 
-HTMLParseContext* HTMLParser::FindContextInStack(Node::Type nodeType)
-{
-	for (Stack<HTMLParseContext>::Entry* entry = contextStack.top; entry; entry = entry->prev)
-	{
-		if (entry->obj.node && entry->obj.node->type == nodeType)
-		{
-			return &entry->obj;
-		}
-	}
-	return nullptr;
-}
-
 void HTMLParser::PushContext(Node* node, const HTMLTagHandler* tag)
 {
 	if (!node)
@@ -80,46 +105,58 @@ void HTMLParser::PushContext(Node* node, const HTMLTagHandler* tag)
 
 	if (contextStackSize >= 0)
 	{
-		Node* parentNode = CurrentContext().node;
-		parentNode->AddChild(node);
+		HTMLParseContext& parentContext = CurrentContext();
+		parentContext.node->AddChild(node, parentContext.lastChild);
 		node->Handler().ApplyStyle(node);
 	}
 
 	contextStack.Push();
 	contextStackSize++;
 
-	contextStack.Top().node = node;
-	contextStack.Top().tag = tag;
+	HTMLParseContext& context = contextStack.Top();
+	context.node = node;
+	context.lastChild = nullptr;
+	context.tag = tag;
 
-	if (node->type == Node::Section)
+	if (contextStackSize == 0)
 	{
-		SectionElement::Data* data = static_cast<SectionElement::Data*>(node);
-		contextStack.Top().parseSection = data->type;
+		context.optionNode = context.buttonNode = nullptr;
+		context.tableNode = context.tableCellNode = nullptr;
 	}
 
+	switch (node->type)
+	{
+	case Node::Section:
+		context.parseSection = static_cast<SectionElement::Data*>(node)->type;
+		break;
+	case Node::Option:
+		context.optionNode = node;
+		break;
+	case Node::Button:
+		context.buttonNode = node;
+		break;
+	case Node::Table:
+		context.tableNode = node;
+		context.tableCellNode = nullptr;
+		break;
+	case Node::TableCell:
+		context.tableCellNode = node;
+		break;
+	default:
+		break;
+	}
+
+	openTagCount[tag ? tag->index : 0]++;
+
 	//node->Handler().BeginLayoutContext(page.layout, node);
 }
 
 void HTMLParser::PopContext(const HTMLTagHandler* tag)
 {
-	if (contextStackSize >= 0)
+	// Check that the context stack has this tag (in case of malformed HTML)
+	if (contextStackSize >= 0 && !openTagCount[tag ? tag->index : 0])
 	{
-		bool hasEntry = false;
-
-		// Check that the context stack has this tag (in case of malformed HTML)
-		for (Stack<HTMLParseContext>::Entry* entry = contextStack.top; entry; entry = entry->prev)
-		{
-			if (entry->obj.tag == tag)
-			{
-				hasEntry = true;
-				break;
-			}
-		}
-
-		if (!hasEntry)
-		{
-			return;
-		}
+		return;
 	}
 
 	// Keep popping contexts until we get to the matching tag
@@ -129,6 +166,8 @@ void HTMLParser::PopContext(const HTMLTagHandler* tag)
 		contextStack.Pop();
 		contextStackSize--;
 
+		openTagCount[parseContext.tag ? parseContext.tag->index : 0]--;
+
 		//parseContext.node->Handler().EndLayoutContext(page.layout, parseContext.node);
 
 		if (parseContext.tag == tag)
@@ -159,128 +198,295 @@ void HTMLParser::Finish()
 	page.GetApp().pageLoadTask.Stop();
 }
 
-#define NUM_AMPERSAND_ESCAPE_SEQUENCES (sizeof(ampersandEscapeSequences) / (2 * sizeof(const char*)))
-const char* ampersandEscapeSequences[] = 
+// Sorted case insensitively so that entities can be found with a binary search. Where two
+// names differ only by case, the capitalised form comes first
+struct AmpersandEscapeSequence
 {
-	"quot",			"\"",
-	"amp",			"&",
-	"lt",			"<",
-	"gt",			">",
-	"nbsp",			"\x1f",
-	"laquo",		"<<",
-	"raquo",		">>",
-	"bull",			"\x95",
-	"iexcl",		"\xA1",					//	¡	161	&iexcl;	inverted exclamation mark
-	"cent",			"\xA2",					//	¢	162	&cent;	cent sign
-	"pound",		"\xA3",					//	£	163	&pound;	pound sign
-	"curren",		"\xA4",					//	¤	164	&curren;	currency sign
-	"yen",			"\xA5",					//	¥	165	&yen;	yen sign
-	"brvbar",		"\xA6",					//	¦	166	&brvbar;	broken bar
-	"sect",			"\xA7",					//	§	167	&sect;	section sign
-	"uml",			"\xA8",					//	¨	168	&uml;	diaeresis
-	"copy",			"\xA9",					//	©	169	&copy;	copyright sign
-	"ordf",			"\xAA",					//	ª	170	&ordf;	feminine ordinal indicator
-	"laquo",		"\xAB",					//	«	171	&laquo;	left-pointing double angle quotation mark
-	"not",			"\xAC",					//	¬	172	&not;	not sign
-	"shy",			"\xAD",					//	�­	173	&shy;	soft hyphen
-	"reg",			"\xAE",					//	®	174	&reg;	registered sign
-	"macr",			"\xAF",					//	¯	175	&macr;	macron
-	"deg",			"\xB0",					//	°	176	&deg;	degree sign
-	"plusmn",		"\xB1",					//	±	177	&plusmn;	plus-minus sign
-	"sup2",			"\xB2",					//	²	178	&sup2;	superscript two
-	"sup3",			"\xB3",					//	³	179	&sup3;	superscript three
-	"acute",		"\xB4",					//	´	180	&acute;	acute accent
-	"micro",		"\xB5",					//	µ	181	&micro;	micro sign
-	"para",			"\xB6",					//	¶	182	&para;	pilcrow sign
-	"middot",		"\xB7",					//	·	183	&middot;	middle dot
-	"cedil",		"\xB8",					//	¸	184	&cedil;	cedilla
-	"sup1",			"\xB9",					//	¹	185	&sup1;	superscript one
-	"ordm",			"\xBA",					//	º	186	&ordm;	masculine ordinal indicator
-	"raquo",		"\xBB",					//	»	187	&raquo;	right-pointing double angle quotation mark
-	"frac14",		"\xBC",					//	¼	188	&frac14;	vulgar fraction one quarter
-	"frac12",		"\xBD",					//	½	189	&frac12;	vulgar fraction one half
-	"frac34",		"\xBE",					//	¾	190	&frac34;	vulgar fraction three quarters
-	"iquest",		"\xBF",					//	¿	191	&iquest;	inverted question mark
-	"Agrave",		"\xC0",					//	À	192	&Agrave;	Latin capital letter A with grave
-	"Aacute",		"\xC1",					//	Á	193	&Aacute;	Latin capital letter A with acute
-	"Acirc",		"\xC2",					//	Â	194	&Acirc;	Latin capital letter A with circumflex
-	"Atilde",		"\xC3",					//	Ã	195	&Atilde;	Latin capital letter A with tilde
-	"Auml",			"\xC4",					//	Ä	196	&Auml;	Latin capital letter A with diaeresis
-	"Aring",		"\xC5",					//	Å	197	&Aring;	Latin capital letter A with ring above
-	"AElig",		"\xC6",					//	Æ	198	&AElig;	Latin capital letter AE
-	"Ccedil",		"\xC7",					//	Ç	199	&Ccedil;	Latin capital letter C with cedilla
-	"Egrave",		"\xC8",					//	È	200	&Egrave;	Latin capital letter E with grave
-	"Eacute",		"\xC9",					//	É	201	&Eacute;	Latin capital letter E with acute
-	"Ecirc",		"\xCA",					//	Ê	202	&Ecirc;	Latin capital letter E with circumflex
-	"Euml",			"\xCB",					//	Ë	203	&Euml;	Latin capital letter E with diaeresis
-	"Igrave",		"\xCC",					//	Ì	204	&Igrave;	Latin capital letter I with grave
-	"Iacute",		"\xCD",					//	Í	205	&Iacute;	Latin capital letter I with acute
-	"Icirc",		"\xCE",					//	Î	206	&Icirc;	Latin capital letter I with circumflex
-	"Iuml",			"\xCF",					//	Ï	207	&Iuml;	Latin capital letter I with diaeresis
-	"ETH",			"\xD0",					//	Ð	208	&ETH;	Latin capital letter Eth
-	"Ntilde",		"\xD1",					//	Ñ	209	&Ntilde;	Latin capital letter N with tilde
-	"Ograve",		"\xD2",					//	Ò	210	&Ograve;	Latin capital letter O with grave
-	"Oacute",		"\xD3",					//	Ó	211	&Oacute;	Latin capital letter O with acute
-	"Ocirc",		"\xD4",					//	Ô	212	&Ocirc;	Latin capital letter O with circumflex
-	"Otilde",		"\xD5",					//	Õ	213	&Otilde;	Latin capital letter O with tilde
-	"Ouml",			"\xD6",					//	Ö	214	&Ouml;	Latin capital letter O with diaeresis
-	"times",		"\xD7",					//	×	215	&times;	multiplication sign
-	"Oslash",		"\xD8",					//	Ø	216	&Oslash;	Latin capital letter O with stroke
-	"Ugrave",		"\xD9",					//	Ù	217	&Ugrave;	Latin capital letter U with grave
-	"Uacute",		"\xDA",					//	Ú	218	&Uacute;	Latin capital letter U with acute
-	"Ucirc",		"\xDB",					//	Û	219	&Ucirc;	Latin capital letter U with circumflex
-	"Uuml",			"\xDC",					//	Ü	220	&Uuml;	Latin capital letter U with diaeresis
-	"Yacute",		"\xDD",					//	Ý	221	&Yacute;	Latin capital letter Y with acute
-	"THORN",		"\xDE",					//	Þ	222	&THORN;	Latin capital letter Thorn
-	"szlig",		"\xDF",					//	ß	223	&szlig;	Latin small letter sharp s
-	"agrave",		"\xE0",					//	à	224	&agrave;	Latin small letter a with grave
-	"aacute",		"\xE1",					//	á	225	&aacute;	Latin small letter a with acute
-	"acirc",		"\xE2",					//	â	226	&acirc;	Latin small letter a with circumflex
-	"atilde",		"\xE3",					//	ã	227	&atilde;	Latin small letter a with tilde
-	"auml",			"\xE4",					//	ä	228	&auml;	Latin small letter a with diaeresis
-	"aring",		"\xE5",					//	å	229	&aring;	Latin small letter a with ring above
-	"aelig",		"\xE6",					//	æ	230	&aelig;	Latin small letter ae
-	"ccedil",		"\xE7",					//	ç	231	&ccedil;	Latin small letter c with cedilla
-	"egrave",		"\xE8",					//	è	232	&egrave;	Latin small letter e with grave
-	"eacute",		"\xE9",					//	é	233	&eacute;	Latin small letter e with acute
-	"ecirc",		"\xEA",					//	ê	234	&ecirc;	Latin small letter e with circumflex
-	"euml",			"\xEB",					//	ë	235	&euml;	Latin small letter e with diaeresis
-	"igrave",		"\xEC",					//	ì	236	&igrave;	Latin small letter i with grave
-	"iacute",		"\xED",					//	í	237	&iacute;	Latin small letter i with acute
-	"icirc",		"\xEE",					//	î	238	&icirc;	Latin small letter i with circumflex
-	"iuml",			"\xEF",					//	ï	239	&iuml;	Latin small letter i with diaeresis
-	"eth",			"\xF0",					//	ð	240	&eth;	Latin small letter eth
-	"ntilde",		"\xF1",					//	ñ	241	&ntilde;	Latin small letter n with tilde
-	"ograve",		"\xF2",					//	ò	242	&ograve;	Latin small letter o with grave
-	"oacute",		"\xF3",					//	ó	243	&oacute;	Latin small letter o with acute
-	"ocirc",		"\xF4",					//	ô	244	&ocirc;	Latin small letter o with circumflex
-	"otilde",		"\xF5",					//	õ	245	&otilde;	Latin small letter o with tilde
-	"ouml",			"\xF6",					//	ö	246	&ouml;	Latin small letter o with diaeresis
-	"divide",		"\xF7",					//	÷	247	&divide;	division sign
-	"oslash",		"\xF8",					//	ø	248	&oslash;	Latin small letter o with stroke
-	"ugrave",		"\xF9",					//	ù	249	&ugrave;	Latin small letter u with grave
-	"uacute",		"\xFA",					//	ú	250	&uacute;	Latin small letter u with acute
-	"ucirc",		"\xFB",					//	û	251	&ucirc;	Latin small letter u with circumflex
-	"uuml",			"\xFC",					//	ü	252	&uuml;	Latin small letter u with diaeresis
-	"yacute",		"\xFD",					//	ý	253	&yacute;	Latin small letter y with acute
-	"thorn",		"\xFE",					//	þ	254	&thorn;	Latin small letter thorn
-	"yuml",			"\xFF",					//	ÿ	255	&yuml;	Latin small letter y with diaeresis
+	const char* name;
+	const char* replacement;
+};
 
+static const AmpersandEscapeSequence ampersandEscapeSequences[] =
+{
+	{ "Aacute",	"\xC1" },		//	Á	193	&Aacute;	Latin capital letter A with acute
+	{ "aacute",	"\xE1" },		//	á	225	&aacute;	Latin small letter a with acute
+	{ "Acirc",	"\xC2" },		//	Â	194	&Acirc;	Latin capital letter A with circumflex
+	{ "acirc",	"\xE2" },		//	â	226	&acirc;	Latin small letter a with circumflex
+	{ "acute",	"\xB4" },		//	´	180	&acute;	acute accent
+	{ "AElig",	"\xC6" },		//	Æ	198	&AElig;	Latin capital letter AE
+	{ "aelig",	"\xE6" },		//	æ	230	&aelig;	Latin small letter ae
+	{ "Agrave",	"\xC0" },		//	À	192	&Agrave;	Latin capital letter A with grave
+	{ "agrave",	"\xE0" },		//	à	224	&agrave;	Latin small letter a with grave
+	{ "amp",		"&" },
+	{ "Aring",	"\xC5" },		//	Å	197	&Aring;	Latin capital letter A with ring above
+	{ "aring",	"\xE5" },		//	å	229	&aring;	Latin small letter a with ring above
+	{ "Atilde",	"\xC3" },		//	Ã	195	&Atilde;	Latin capital letter A with tilde
+	{ "atilde",	"\xE3" },		//	ã	227	&atilde;	Latin small letter a with tilde
+	{ "Auml",		"\xC4" },		//	Ä	196	&Auml;	Latin capital letter A with diaeresis
+	{ "auml",		"\xE4" },		//	ä	228	&auml;	Latin small letter a with diaeresis
+	{ "brvbar",	"\xA6" },		//	¦	166	&brvbar;	broken bar
+	{ "bull",		"\x95" },
+	{ "Ccedil",	"\xC7" },		//	Ç	199	&Ccedil;	Latin capital letter C with cedilla
+	{ "ccedil",	"\xE7" },		//	ç	231	&ccedil;	Latin small letter c with cedilla
+	{ "cedil",	"\xB8" },		//	¸	184	&cedil;	cedilla
+	{ "cent",		"\xA2" },		//	¢	162	&cent;	cent sign
+	{ "copy",		"\xA9" },		//	©	169	&copy;	copyright sign
+	{ "curren",	"\xA4" },		//	¤	164	&curren;	currency sign
+	{ "deg",		"\xB0" },		//	°	176	&deg;	degree sign
+	{ "divide",	"\xF7" },		//	÷	247	&divide;	division sign
+	{ "Eacute",	"\xC9" },		//	É	201	&Eacute;	Latin capital letter E with acute
+	{ "eacute",	"\xE9" },		//	é	233	&eacute;	Latin small letter e with acute
+	{ "Ecirc",	"\xCA" },		//	Ê	202	&Ecirc;	Latin capital letter E with circumflex
+	{ "ecirc",	"\xEA" },		//	ê	234	&ecirc;	Latin small letter e with circumflex
+	{ "Egrave",	"\xC8" },		//	È	200	&Egrave;	Latin capital letter E with grave
+	{ "egrave",	"\xE8" },		//	è	232	&egrave;	Latin small letter e with grave
+	{ "ETH",		"\xD0" },		//	Ð	208	&ETH;	Latin capital letter Eth
+	{ "eth",		"\xF0" },		//	ð	240	&eth;	Latin small letter eth
+	{ "Euml",		"\xCB" },		//	Ë	203	&Euml;	Latin capital letter E with diaeresis
+	{ "euml",		"\xEB" },		//	ë	235	&euml;	Latin small letter e with diaeresis
+	{ "frac12",	"\xBD" },		//	½	189	&frac12;	vulgar fraction one half
+	{ "frac14",	"\xBC" },		//	¼	188	&frac14;	vulgar fraction one quarter
+	{ "frac34",	"\xBE" },		//	¾	190	&frac34;	vulgar fraction three quarters
+	{ "gt",		">" },
+	{ "Iacute",	"\xCD" },		//	Í	205	&Iacute;	Latin capital letter I with acute
+	{ "iacute",	"\xED" },		//	í	237	&iacute;	Latin small letter i with acute
+	{ "Icirc",	"\xCE" },		//	Î	206	&Icirc;	Latin capital letter I with circumflex
+	{ "icirc",	"\xEE" },		//	î	238	&icirc;	Latin small letter i with circumflex
+	{ "iexcl",	"\xA1" },		//	¡	161	&iexcl;	inverted exclamation mark
+	{ "Igrave",	"\xCC" },		//	Ì	204	&Igrave;	Latin capital letter I with grave
+	{ "igrave",	"\xEC" },		//	ì	236	&igrave;	Latin small letter i with grave
+	{ "iquest",	"\xBF" },		//	¿	191	&iquest;	inverted question mark
+	{ "Iuml",		"\xCF" },		//	Ï	207	&Iuml;	Latin capital letter I with diaeresis
+	{ "iuml",		"\xEF" },		//	ï	239	&iuml;	Latin small letter i with diaeresis
+	{ "laquo",	"<<" },
+	{ "lt",		"<" },
+	{ "macr",		"\xAF" },		//	¯	175	&macr;	macron
+	{ "micro",	"\xB5" },		//	µ	181	&micro;	micro sign
+	{ "middot",	"\xB7" },		//	·	183	&middot;	middle dot
+	{ "nbsp",		"\x1f" },
+	{ "not",		"\xAC" },		//	¬	172	&not;	not sign
+	{ "Ntilde",	"\xD1" },		//	Ñ	209	&Ntilde;	Latin capital letter N with tilde
+	{ "ntilde",	"\xF1" },		//	ñ	241	&ntilde;	Latin small letter n with tilde
+	{ "Oacute",	"\xD3" },		//	Ó	211	&Oacute;	Latin capital letter O with acute
+	{ "oacute",	"\xF3" },		//	ó	243	&oacute;	Latin small letter o with acute
+	{ "Ocirc",	"\xD4" },		//	Ô	212	&Ocirc;	Latin capital letter O with circumflex
+	{ "ocirc",	"\xF4" },		//	ô	244	&ocirc;	Latin small letter o with circumflex
+	{ "Ograve",	"\xD2" },		//	Ò	210	&Ograve;	Latin capital letter O with grave
+	{ "ograve",	"\xF2" },		//	ò	242	&ograve;	Latin small letter o with grave
+	{ "ordf",		"\xAA" },		//	ª	170	&ordf;	feminine ordinal indicator
+	{ "ordm",		"\xBA" },		//	º	186	&ordm;	masculine ordinal indicator
+	{ "Oslash",	"\xD8" },		//	Ø	216	&Oslash;	Latin capital letter O with stroke
+	{ "oslash",	"\xF8" },		//	ø	248	&oslash;	Latin small letter o with stroke
+	{ "Otilde",	"\xD5" },		//	Õ	213	&Otilde;	Latin capital letter O with tilde
+	{ "otilde",	"\xF5" },		//	õ	245	&otilde;	Latin small letter o with tilde
+	{ "Ouml",		"\xD6" },		//	Ö	214	&Ouml;	Latin capital letter O with diaeresis
+	{ "ouml",		"\xF6" },		//	ö	246	&ouml;	Latin small letter o with diaeresis
+	{ "para",		"\xB6" },		//	¶	182	&para;	pilcrow sign
+	{ "plusmn",	"\xB1" },		//	±	177	&plusmn;	plus-minus sign
+	{ "pound",	"\xA3" },		//	£	163	&pound;	pound sign
+	{ "quot",		"\"" },
+	{ "raquo",	">>" },
+	{ "reg",		"\xAE" },		//	®	174	&reg;	registered sign
+	{ "sect",		"\xA7" },		//	§	167	&sect;	section sign
+	{ "shy",		"\xAD" },		//	�­	173	&shy;	soft hyphen
+	{ "sup1",		"\xB9" },		//	¹	185	&sup1;	superscript one
+	{ "sup2",		"\xB2" },		//	²	178	&sup2;	superscript two
+	{ "sup3",		"\xB3" },		//	³	179	&sup3;	superscript three
+	{ "szlig",	"\xDF" },		//	ß	223	&szlig;	Latin small letter sharp s
+	{ "THORN",	"\xDE" },		//	Þ	222	&THORN;	Latin capital letter Thorn
+	{ "thorn",	"\xFE" },		//	þ	254	&thorn;	Latin small letter thorn
+	{ "times",	"\xD7" },		//	×	215	&times;	multiplication sign
+	{ "Uacute",	"\xDA" },		//	Ú	218	&Uacute;	Latin capital letter U with acute
+	{ "uacute",	"\xFA" },		//	ú	250	&uacute;	Latin small letter u with acute
+	{ "Ucirc",	"\xDB" },		//	Û	219	&Ucirc;	Latin capital letter U with circumflex
+	{ "ucirc",	"\xFB" },		//	û	251	&ucirc;	Latin small letter u with circumflex
+	{ "Ugrave",	"\xD9" },		//	Ù	217	&Ugrave;	Latin capital letter U with grave
+	{ "ugrave",	"\xF9" },		//	ù	249	&ugrave;	Latin small letter u with grave
+	{ "uml",		"\xA8" },		//	¨	168	&uml;	diaeresis
+	{ "Uuml",		"\xDC" },		//	Ü	220	&Uuml;	Latin capital letter U with diaeresis
+	{ "uuml",		"\xFC" },		//	ü	252	&uuml;	Latin small letter u with diaeresis
+	{ "Yacute",	"\xDD" },		//	Ý	221	&Yacute;	Latin capital letter Y with acute
+	{ "yacute",	"\xFD" },		//	ý	253	&yacute;	Latin small letter y with acute
+	{ "yen",		"\xA5" },		//	¥	165	&yen;	yen sign
+	{ "yuml",		"\xFF" },		//	ÿ	255	&yuml;	Latin small letter y with diaeresis
 };
 
+#define NUM_AMPERSAND_ESCAPE_SEQUENCES (sizeof(ampersandEscapeSequences) / sizeof(AmpersandEscapeSequence))
+
 void HTMLParser::AppendTextBuffer(char c)
 {
-	if(textBufferSize == sizeof(textBuffer) - 1)
+	if(textBufferSize == textBufferCapacity - 1 && !GrowTextBuffer())
 	{
 		FlushTextBuffer();
 	}
-	if(textBufferSize < sizeof(textBuffer) - 1)
+	if (textBufferSize == 0)
+	{
+		BeginTextRun();
+	}
+	if(textBufferSize < textBufferCapacity - 1)
 	{
 		textBuffer[textBufferSize] = c;
 		textBufferSize++;
 	}
 }
 
+void HTMLParser::AppendTextBuffer(const char* text, size_t length)
+{
+	while (length)
+	{
+		if (textBufferSize == textBufferCapacity - 1 && !GrowTextBuffer())
+		{
+			FlushTextBuffer();
+		}
+		if (textBufferSize == 0)
+		{
+			BeginTextRun();
+		}
+
+		size_t space = textBufferCapacity - 1 - textBufferSize;
+		if (space > length)
+		{
+			space = length;
+		}
+
+		memcpy(textBuffer + textBufferSize, text, space);
+		textBufferSize += space;
+		text += space;
+		length -= space;
+	}
+}
+
+bool HTMLParser::IsTextRunDestination()
+{
+	switch (parseState)
+	{
+	case ParsePlainText:
+		return true;
+	case ParseText:
+	case ParseAmpersandEscape:
+		if (CurrentContext().optionNode || CurrentContext().buttonNode)
+		{
+			return false;
+		}
+		switch (CurrentSection())
+		{
+		case SectionElement::Title:
+		case SectionElement::Script:
+		case SectionElement::Style:
+			return false;
+		default:
+			return true;
+		}
+	default:
+		return false;
+	}
+}
+
+// Text that will end up in a text node is written straight into the block the node will own,
+// rather than being copied out of the fixed text buffer when it is flushed. If the block
+// allocator can't give us memory that is directly addressable then the fixed buffer is used
+void HTMLParser::BeginTextRun()
+{
+	if (textRun.IsAllocated() || !IsTextRunDestination())
+	{
+		return;
+	}
+
+	if (spareTextRun.IsAllocated())
+	{
+		textRun = spareTextRun;
+		textBufferCapacity = spareTextRunSize;
+		spareTextRun = MemBlockHandle();
+		spareTextRunSize = 0;
+	}
+	else
+	{
+		textRun = MemoryManager::pageBlockAllocator.AllocateGrowable(TEXT_RUN_INITIAL_SIZE);
+		textBufferCapacity = TEXT_RUN_INITIAL_SIZE;
+	}
+
+	if (textRun.IsAllocated())
+	{
+		textBuffer = textRun.Get<char*>();
+	}
+	else
+	{
+		textBufferCapacity = sizeof(fixedTextBuffer);
+	}
+}
+
+// Blocks can't be freed out of order from the block allocator, so a run that is given up
+// is kept for the next run to start in rather than being lost
+void HTMLParser::KeepSpareTextRun(MemBlockHandle run, size_t size)
+{
+	if (size > spareTextRunSize)
+	{
+		spareTextRun = run;
+		spareTextRunSize = size;
+	}
+}
+
+bool HTMLParser::GrowTextBuffer()
+{
+	if (!textRun.IsAllocated())
+	{
+		return false;
+	}
+
+	size_t maxCapacity = MemoryManager::pageBlockAllocator.MaxGrowableSize(textRun);
+	if (textBufferCapacity >= maxCapacity)
+	{
+		return false;
+	}
+
+	size_t newCapacity = textBufferCapacity * 2;
+	if (newCapacity > maxCapacity)
+	{
+		newCapacity = maxCapacity;
+	}
+
+	if (MemoryManager::pageBlockAllocator.Resize(textRun, (uint16_t)textBufferCapacity, (uint16_t)newCapacity))
+	{
+		textBuffer = textRun.Get<char*>();
+		textBufferCapacity = newCapacity;
+		return true;
+	}
+
+	// Something else has been allocated since the run started so it has to move
+	MemBlockHandle newRun = MemoryManager::pageBlockAllocator.AllocateGrowable((uint16_t)newCapacity);
+	if (!newRun.IsAllocated())
+	{
+		return false;
+	}
+
+	char* newBuffer = newRun.Get<char*>();
+	memcpy(newBuffer, textRun.Get<char*>(), textBufferSize);
+	KeepSpareTextRun(textRun, textBufferCapacity);
+	textRun = newRun;
+	textBuffer = newBuffer;
+	textBufferCapacity = newCapacity;
+	return true;
+}
+
+// The text node takes over the run's block as its storage
+void HTMLParser::EmitTextRun()
+{
+	if (textBufferSize > 0)
+	{
+		// Hand back the unused space if nothing else has been allocated since
+		MemoryManager::pageBlockAllocator.Resize(textRun, (uint16_t)textBufferCapacity, (uint16_t)(textBufferSize + 1));
+		EmitNode(TextElement::Construct(MemoryManager::pageAllocator, textRun));
+	}
+	else if (!MemoryManager::pageBlockAllocator.Resize(textRun, (uint16_t)textBufferCapacity, 0))
+	{
+		KeepSpareTextRun(textRun, textBufferCapacity);
+	}
+
+	textRun = MemBlockHandle();
+	textBuffer = fixedTextBuffer;
+	textBufferCapacity = sizeof(fixedTextBuffer);
+}
+
 void HTMLParser::EmitText(const char* text)
 {
 	EmitNode(TextElement::Construct(MemoryManager::pageAllocator, text));
@@ -294,37 +500,14 @@ void HTMLParser::EmitNode(Node* node)
 	}
 
 	// Check if this is part of a table - if so, make sure we are in a cell
-	Node* tableContainer = nullptr;
-	for (Node* n = CurrentContext().node; n; n = n->parent.Get())
-	{
-		if (n->type == Node::Table)
-		{
-			tableContainer = n;
-			break;
-		}
-	}
-	if (tableContainer)
+	if (CurrentContext().tableNode && !CurrentContext().tableCellNode)
 	{
-		bool isInCell = false;
-
-		for (Node* n = CurrentContext().node; n != tableContainer; n = n->parent.Get())
-		{
-			if (n->type == Node::TableCell)
-			{
-				isInCell = true;
-				break;
-			}
-		}
-
-		if (!isInCell)
-		{
-			// Don't emit the node. In other browsers the content gets emitted before the table?
-			return;
-		}
+		// Don't emit the node. In other browsers the content gets emitted before the table?
+		return;
 	}
 
-	Node* parentNode = CurrentContext().node;
-	parentNode->AddChild(node);
+	HTMLParseContext& parentContext = CurrentContext();
+	parentContext.node->AddChild(node, parentContext.lastChild);
 
 	node->Handler().ApplyStyle(node);
 
@@ -345,25 +528,33 @@ void HTMLParser::EmitImage(Image* image, int imageWidth, int imageHeight)
 
 void HTMLParser::FlushTextBuffer()
 {
+	if (textRun.IsAllocated())
+	{
+		// EMS mapping may have changed since the run was last written to
+		textBuffer = textRun.Get<char*>();
+	}
 	textBuffer[textBufferSize] = '\0';
 	
 	switch(parseState)
 	{
 		case ParseText:
 		{
-			if(textBufferSize > 0)
+			if (textRun.IsAllocated())
+			{
+				EmitTextRun();
+			}
+			else if(textBufferSize > 0)
 			{
-				HTMLParseContext* optionContext = FindContextInStack(Node::Option);
-				HTMLParseContext* buttonContext = FindContextInStack(Node::Button);
+				HTMLParseContext& context = CurrentContext();
 
-				if (optionContext)
+				if (context.optionNode)
 				{
-					OptionNode::Data* option = static_cast<OptionNode::Data*>(optionContext->node);
+					OptionNode::Data* option = static_cast<OptionNode::Data*>(context.optionNode);
 					option->text = MemoryManager::pageAllocator.AllocString(textBuffer);
 				}
-				else if (buttonContext)
+				else if (context.buttonNode)
 				{
-					ButtonNode::Data* button = static_cast<ButtonNode::Data*>(buttonContext->node);
+					ButtonNode::Data* button = static_cast<ButtonNode::Data*>(context.buttonNode);
 					button->buttonText = MemoryManager::pageAllocator.AllocString(textBuffer);
 				}
 				else
@@ -441,24 +632,24 @@ void HTMLParser::FlushTextBuffer()
 						AttributeParser attributes(attributeStr);
 						while (attributes.Parse())
 						{
-							if (!stricmp(attributes.Key(), "align"))
+							if (attributes.KeyId() == AttributeKey::Align)
 							{
 								ElementStyle style = CurrentContext().node->GetStyle();
-								if (!stricmp(attributes.Value(), "center"))
+								if (attributes.ValueIs("center"))
 								{
 									style.alignment = ElementAlignment::Center;
 								}
-								else if (!stricmp(attributes.Value(), "left"))
+								else if (attributes.ValueIs("left"))
 								{
 									style.alignment = ElementAlignment::Left;
 								}
-								else if (!stricmp(attributes.Value(), "right"))
+								else if (attributes.ValueIs("right"))
 								{
 									style.alignment = ElementAlignment::Right;
 								}
 								CurrentContext().node->SetStyle(style);
 							}
-							if (!stricmp(attributes.Key(), "name"))
+							if (attributes.KeyId() == AttributeKey::Name)
 							{
 								if (App::Get().ui.jumpTagName && !stricmp(attributes.Value(), App::Get().ui.jumpTagName + 1))
 								{
@@ -473,184 +664,333 @@ void HTMLParser::FlushTextBuffer()
 		break;
 		case ParseAmpersandEscape:
 		{
-			// Flush everything before the escape sequence started
+			// Flush everything before the escape sequence started and carry the partial sequence over
 			if (escapeSequenceStartIndex)
 			{
+				char escapeSequence[MAX_ESCAPE_SEQUENCE_LENGTH + 1];
+				size_t escapeSequenceLength = textBufferSize - escapeSequenceStartIndex;
+				memcpy(escapeSequence, textBuffer + escapeSequenceStartIndex, escapeSequenceLength);
+
 				textBufferSize = escapeSequenceStartIndex;
 				parseState = ParseText;
 				FlushTextBuffer();
 				parseState = ParseAmpersandEscape;
-				textBuffer[escapeSequenceStartIndex] = '&';
-				strcpy(textBuffer, textBuffer + escapeSequenceStartIndex);
+
+				// The flush emitted the run, so start a new one for the rest of the text
+				BeginTextRun();
+				memcpy(textBuffer, escapeSequence, escapeSequenceLength);
+				textBufferSize = escapeSequenceLength;
+				escapeSequenceStartIndex = 0;
 			}
 			return;
 		}
 		break;
 
 		case ParsePlainText:
-			if(textBufferSize)
+			if (textRun.IsAllocated())
+				EmitTextRun();
+			else if(textBufferSize)
 				EmitText(textBuffer);
 		break;
+
+		case ParseRawText:
+			// Script and style contents are skipped without being buffered
+		break;
+
+		default:
+		break;
 	}
-	
+
 	textBufferSize = 0;
 	textBuffer[0] = '\0';
 }
 
-const char* HTMLParser::GetUnicodeString(int unicodePoint)
+const char* HTMLParser::GetUnicodeString(uint32_t unicodePoint)
 {
-	TextEncodingPage* encodingPage = NULL;
-
 	if (unicodePoint >= 0x80 && unicodePoint <= 0xff)
 	{
-		encodingPage = &UTF8_Latin1Supplement;
-		unicodePoint -= 0x80;
+		return UTF8_Latin1Supplement.replacement[unicodePoint - 0x80];
 	}
 	else if (unicodePoint >= 0x100 && unicodePoint <= 0x17f)
 	{
-		encodingPage = &UTF8_LatinExtendedA;
-		unicodePoint -= 0x100;
+		return UTF8_LatinExtendedA.replacement[unicodePoint - 0x100];
 	}
-
-	if (encodingPage)
+	else if (unicodePoint >= 0x2000 && unicodePoint <= 0x207f)
 	{
-		return encodingPage->replacement[unicodePoint];
+		return UTF8_GeneralPunctuation.replacement[unicodePoint - 0x2000];
 	}
-	else
+	else if (unicodePoint >= 0x300 && unicodePoint <= 0x36f)
+	{
+		// Combining diacritical marks: the base character is shown on its own
+		return "";
+	}
+	else if (unicodePoint >= 0x380 && unicodePoint <= 0x3ff)
+	{
+		return UTF8_Greek.replacement[unicodePoint - 0x380];
+	}
+	else if (unicodePoint >= 0x400 && unicodePoint <= 0x47f)
+	{
+		return UTF8_Cyrillic.replacement[unicodePoint - 0x400];
+	}
+	else if (unicodePoint >= 0xff01 && unicodePoint <= 0xff5e)
+	{
+		// Full width forms of the printable ASCII characters
+		static char fullWidthReplacement[2];
+		fullWidthReplacement[0] = (char)(unicodePoint - 0xff01 + '!');
+		return fullWidthReplacement;
+	}
+	else if (unicodePoint >= 0x2500 && unicodePoint <= 0x257f)
 	{
+		// Box drawing: horizontal and vertical lines, everything else is a join
+		switch (unicodePoint)
+		{
+		case 0x2500: case 0x2501: case 0x2504: case 0x2505: case 0x2508: case 0x2509: case 0x254c: case 0x254d: case 0x2550:
+			return "-";
+		case 0x2502: case 0x2503: case 0x2506: case 0x2507: case 0x250a: case 0x250b: case 0x254e: case 0x254f: case 0x2551:
+			return "|";
+		default:
+			return "+";
+		}
+	}
+
+	// Other characters that are common enough to be worth approximating. Anything else, e.g.
+	// other scripts, CJK and most symbols, has no sensible single byte form and shows as "?"
+	switch (unicodePoint)
+	{
+	case 0x192:		// Latin small letter f with hook
+		return "f";
+	case 0x2c6:		// Modifier letter circumflex accent
+	case 0x2c7:		// Caron
+	case 0x2d8:		// Breve
+		return "^";
+	case 0x2d9:		// Dot above
+		return "'";
+	case 0x2da:		// Ring above
+		return "\xB0";
+	case 0x2db:		// Ogonek
+		return ",";
+	case 0x2dc:		// Small tilde
+		return "~";
+	case 0x2dd:		// Double acute accent
+		return "\"";
+	case 0x218:		// Latin capital letter S with comma below
+		return "S";
+	case 0x219:		// Latin small letter s with comma below
+		return "s";
+	case 0x21a:		// Latin capital letter T with comma below
+		return "T";
+	case 0x21b:		// Latin small letter t with comma below
+		return "t";
+	case 0x2bb:		// Modifier letter turned comma
+	case 0x2bc:		// Modifier letter apostrophe
+		return "'";
+	case 0x490:		// Cyrillic capital letter ghe with upturn
+		return "G";
+	case 0x491:		// Cyrillic small letter ghe with upturn
+		return "g";
+	case 0x20ac:	// Euro sign
+		return "E";
+	case 0x2116:	// Numero sign
+		return "No";
+	case 0x2122:	// Trade mark sign
+		return "TM";
+	case 0x2190:	// Leftwards arrow
+		return "<-";
+	case 0x2191:	// Upwards arrow
+		return "^";
+	case 0x2192:	// Rightwards arrow
+		return "->";
+	case 0x2193:	// Downwards arrow
+		return "v";
+	case 0x2194:	// Left right arrow
+		return "<->";
+	case 0x21d0:	// Leftwards double arrow
+		return "<=";
+	case 0x21d2:	// Rightwards double arrow
+		return "=>";
+	case 0x2212:	// Minus sign
+		return "-";
+	case 0x2215:	// Division slash
+		return "/";
+	case 0x2217:	// Asterisk operator
+		return "*";
+	case 0x221e:	// Infinity
+		return "oo";
+	case 0x2248:	// Almost equal to
+		return "~";
+	case 0x2260:	// Not equal to
+		return "!=";
+	case 0x2264:	// Less-than or equal to
+		return "<=";
+	case 0x2265:	// Greater-than or equal to
+		return ">=";
+	case 0x25a0:	// Black square
+	case 0x25aa:	// Black small square
+	case 0x25cf:	// Black circle
+		return "\x95";
+	case 0x25b2:	// Black up-pointing triangle
+		return "^";
+	case 0x25b6:	// Black right-pointing triangle
+	case 0x25ba:	// Black right-pointing pointer
+		return ">";
+	case 0x25bc:	// Black down-pointing triangle
+		return "v";
+	case 0x25c0:	// Black left-pointing triangle
+	case 0x25c4:	// Black left-pointing pointer
+		return "<";
+	case 0x2605:	// Black star
+	case 0x2606:	// White star
+		return "*";
+	case 0x2713:	// Check mark
+	case 0x2714:	// Heavy check mark
+		return "v";
+	case 0x2717:	// Ballot X
+	case 0x2718:	// Heavy ballot X
+		return "x";
+	case 0x3000:	// Ideographic space
+		return " ";
+	case 0xfeff:	// Byte order mark
+		return "";
+	default:
 		return "?";
 	}
 }
 
-void HTMLParser::ReplaceAmpersandEscapeSequences(char* buffer, bool replaceNonBreakingSpace)
+// Case insensitive comparison of a null terminated entity name against a sequence that is not
+static int CompareEscapeSequenceName(const char* name, const char* sequence, int sequenceLength)
 {
-	while (*buffer)
+	for (int i = 0; i < sequenceLength; i++)
 	{
-		if (*buffer == '&')
+		int diff = tolower(name[i]) - tolower(sequence[i]);
+		if (diff || !name[i])
 		{
-			buffer++;
+			return diff;
+		}
+	}
+	return name[sequenceLength] ? 1 : 0;
+}
+
+const char* HTMLParser::DecodeEscapeSequence(const char* sequence, int sequenceLength)
+{
+	if (*sequence == '#')
+	{
+		// This is a entity number
+		long number = 0;
+		int i = 1;
 
-			// Find length of sequence
-			int escapeSequenceLength = 0;
-			while (buffer[escapeSequenceLength] && buffer[escapeSequenceLength] != ';' && !IsWhiteSpace(buffer[escapeSequenceLength]))
+		if (sequenceLength > 1 && (sequence[1] == 'x' || sequence[1] == 'X'))
+		{
+			// Hex number
+			for (i = 2; i < sequenceLength && isxdigit(sequence[i]) && number < 0x110000; i++)
 			{
-				escapeSequenceLength++;
+				number = number * 16 + (isdigit(sequence[i]) ? sequence[i] - '0' : tolower(sequence[i]) - 'a' + 10);
 			}
-			bool correctlyTerminated = buffer[escapeSequenceLength] == ';';
-			char* nextBufferPosition = correctlyTerminated ? buffer + escapeSequenceLength + 1 : buffer + escapeSequenceLength;
-
-			if(escapeSequenceLength > 0)
+		}
+		else
+		{
+			for (i = 1; i < sequenceLength && isdigit(sequence[i]) && number < 0x110000; i++)
 			{
-				if (*buffer == '#')
-				{
-					int number = 0;
+				number = number * 10 + sequence[i] - '0';
+			}
+		}
 
-					// This is a entity number
-					if (buffer[1] == 'x' || buffer[1] == 'X')
-					{
-						// Hex number
-						number = strtol(buffer + 2, NULL, 16);
-					}
-					else
-					{
-						number = atoi(buffer + 1);
-					}
-					buffer--;
+		if (number > FIRST_FONT_GLYPH && number < 128)
+		{
+			static char asciiReplacement[2];
+			asciiReplacement[0] = (char)(number);
+			return asciiReplacement;
+		}
 
-					if (number > FIRST_FONT_GLYPH && number < 128)
-					{
-						*buffer = (char)(number);
-						strcpy(buffer + 1, nextBufferPosition);
-					}
-					else
-					{
-						const char* unicodeReplacementText = GetUnicodeString(number);
-						int replacementTextLength = (int)strlen(unicodeReplacementText);
-						memcpy(buffer, unicodeReplacementText, replacementTextLength);
-						strcpy(buffer + replacementTextLength, nextBufferPosition);
-						buffer += replacementTextLength - 1;
-					}
-				}
-				else
-				{
-					int matchingEscapeSequence = -1;
+		return GetUnicodeString((uint32_t)number);
+	}
 
-					for (int n = 0; n < NUM_AMPERSAND_ESCAPE_SEQUENCES; n++)
-					{
-						const char* escapeSequence = ampersandEscapeSequences[n * 2];
-						bool matching = true;
+	// Binary search for the first entry matching case insensitively
+	unsigned int low = 0;
+	unsigned int high = NUM_AMPERSAND_ESCAPE_SEQUENCES;
+	while (low < high)
+	{
+		unsigned int mid = (low + high) >> 1;
+		if (CompareEscapeSequenceName(ampersandEscapeSequences[mid].name, sequence, sequenceLength) < 0)
+		{
+			low = mid + 1;
+		}
+		else
+		{
+			high = mid;
+		}
+	}
 
-						for (int i = 0; i < escapeSequenceLength; i++)
-						{
-							if (escapeSequence[i] == '\0')
-							{
-								matching = false;
-								break;
-							}
-							if (buffer[i] != escapeSequence[i])
-							{
-								matching = false;
-								break;
-							}
-						}
+	if (low == NUM_AMPERSAND_ESCAPE_SEQUENCES || CompareEscapeSequenceName(ampersandEscapeSequences[low].name, sequence, sequenceLength))
+	{
+		return NULL;
+	}
 
-						if (matching && escapeSequence[escapeSequenceLength] == '\0')
-						{
-							matchingEscapeSequence = n;
-							break;
-						}
-					}
+	// Prefer an exact case match (e.g. &eacute; over &Eacute;)
+	for (unsigned int n = low; n < NUM_AMPERSAND_ESCAPE_SEQUENCES && !CompareEscapeSequenceName(ampersandEscapeSequences[n].name, sequence, sequenceLength); n++)
+	{
+		if (!strncmp(ampersandEscapeSequences[n].name, sequence, sequenceLength))
+		{
+			return ampersandEscapeSequences[n].replacement;
+		}
+	}
 
-					if (matchingEscapeSequence == -1)
-					{
-						for (int n = 0; n < NUM_AMPERSAND_ESCAPE_SEQUENCES; n++)
-						{
-							// Look again but this time non case sensitive comparison
-							const char* escapeSequence = ampersandEscapeSequences[n * 2];
-							bool matching = true;
+	return ampersandEscapeSequences[low].replacement;
+}
 
-							for (int i = 0; i < escapeSequenceLength; i++)
-							{
-								if (escapeSequence[i] == '\0')
-								{
-									matching = false;
-									break;
-								}
-								if (tolower(buffer[i]) != tolower(escapeSequence[i]))
-								{
-									matching = false;
-									break;
-								}
-							}
+void HTMLParser::ReplaceAmpersandEscapeSequences(char* buffer, bool replaceNonBreakingSpace)
+{
+	// Nothing changes before the first escape sequence
+	char* readPtr = strchr(buffer, '&');
+	if (!readPtr)
+	{
+		return;
+	}
 
-							if (matching && escapeSequence[escapeSequenceLength] == '\0')
-							{
-								matchingEscapeSequence = n;
-								break;
-							}
-						}
-					}
+	// Replacement text is never longer than the escape sequence it replaces, so the buffer
+	// can be rewritten in a single pass with the write pointer trailing the read pointer
+	char* writePtr = readPtr;
 
-					if (matchingEscapeSequence != -1)
-					{
-						buffer--;	// One step backwards to write over the &
-						const char* replacementText = ampersandEscapeSequences[matchingEscapeSequence * 2 + 1];
-						int replacementTextLength = (int)strlen(replacementText);
-						memcpy(buffer, replacementText, replacementTextLength);
-						strcpy(buffer + replacementTextLength, nextBufferPosition);
+	while (*readPtr)
+	{
+		if (*readPtr != '&')
+		{
+			*writePtr++ = *readPtr++;
+			continue;
+		}
 
-						if (replaceNonBreakingSpace && *buffer == '\x1f')
-						{
-							*buffer = ' ';
-						}
+		// Find length of sequence
+		const char* sequence = readPtr + 1;
+		int escapeSequenceLength = 0;
+		while (sequence[escapeSequenceLength] && sequence[escapeSequenceLength] != ';' && !IsWhiteSpace(sequence[escapeSequenceLength]))
+		{
+			escapeSequenceLength++;
+		}
+		bool correctlyTerminated = sequence[escapeSequenceLength] == ';';
+		char* nextReadPosition = (char*) sequence + escapeSequenceLength + (correctlyTerminated ? 1 : 0);
 
-						buffer += replacementTextLength - 1;
-					}
-				}
+		const char* replacementText = escapeSequenceLength > 0 ? DecodeEscapeSequence(sequence, escapeSequenceLength) : NULL;
+
+		if (replacementText && (int)strlen(replacementText) <= nextReadPosition - readPtr)
+		{
+			if (replaceNonBreakingSpace && *replacementText == '\x1f')
+			{
+				*writePtr++ = ' ';
+				replacementText++;
 			}
+			while (*replacementText)
+			{
+				*writePtr++ = *replacementText++;
+			}
+			readPtr = nextReadPosition;
+		}
+		else
+		{
+			// Not a recognised sequence, leave the & in place
+			*writePtr++ = *readPtr++;
 		}
-		buffer++;
 	}
+
+	*writePtr = '\0';
 }
 
 bool HTMLParser::IsWhiteSpace(char c)
@@ -663,94 +1003,166 @@ void HTMLParser::Write(const char* str)
 	Parse((char*) str, strlen(str));
 }
 
-void HTMLParser::Parse(char* buffer, size_t count)
+// Fast path for runs of ordinary text: copies whole spans into the text buffer and only
+// returns to the per character state machine at tags, escapes and non-ASCII characters
+size_t HTMLParser::ParseTextSpan(const char* buffer, size_t count)
 {
-	while (count && MemoryManager::pageAllocator.GetError() == LinearAllocator::Error_None)
+	const char* ptr = buffer;
+	const char* end = buffer + count;
+
+	while (ptr < end)
 	{
-		char c = *buffer++;
-		count--;
+		const char* spanStart = ptr;
+		while (ptr < end && textCharClass[(uint8_t)*ptr] == TextChar_Plain)
+		{
+			ptr++;
+		}
+		if (ptr > spanStart)
+		{
+			AppendTextBuffer(spanStart, ptr - spanStart);
+		}
 
-		if ((unsigned char)c > 127)
+		if (ptr == end || textCharClass[(uint8_t)*ptr] != TextChar_WhiteSpace)
+		{
+			break;
+		}
+
+		char c = *ptr;
+		if (!preformatted)
 		{
-			switch (textEncoding)
+			// Collapse white space
+			if (textBufferSize > 0 && !IsWhiteSpace(textBuffer[textBufferSize - 1]))
 			{
-			case TextEncoding::UTF8:
-				if (!parsingUnicode)
-				{
-					parsingUnicode = true;
-					unicodePoint = 0;
+				AppendTextBuffer(' ');
+			}
+		}
+		else if (c == ' ' || c == '\t')
+		{
+			AppendTextBuffer(c);
+		}
+		else
+		{
+			// New lines in preformatted text emit break nodes
+			break;
+		}
+		ptr++;
+	}
 
-					unsigned char code = (unsigned char)(c);
-					if ((code & 0xe0) == 0xc0)		// Starts with 110
-					{
-						unicodeByteCount = 2;
-						unicodePoint = (code & 0x1f);
-					}
-					else if ((code & 0xf0) == 0xe0)		// Starts with 1110
-					{
-						unicodeByteCount = 3;
-						unicodePoint = (code & 0xf);
-					}
-					else if ((code & 0xf8) == 0xf0)		// Starts with 11110
-					{
-						unicodeByteCount = 4;
-						unicodePoint = (code & 0x7);
-					}
-					else
-					{
-						// Invalid
-						parsingUnicode = false;
-					}
+	if (ptr > buffer)
+	{
+		utf8State = UTF8_ACCEPT;
+	}
 
-					if (parsingUnicode)
-					{
-						unicodeByteCount--;
-						unicodePoint <<= 6;
-					}
-				}
-				else
-				{
-					unsigned char code = (unsigned char)(c);
+	return ptr - buffer;
+}
 
-					unicodePoint |= (code & 0x3f);
-					unicodeByteCount--;
+void HTMLParser::BeginSkip(ParseState state, const char* terminator)
+{
+	parseState = state;
+	skipTerminator = terminator;
+	skipMatchLength = 0;
+	textBufferSize = 0;
+}
 
-					if (unicodeByteCount)
-					{
-						unicodePoint <<= 6;
-					}
-					else
-					{
-						// Unicode point is complete
-						parsingUnicode = false;
+// Comments, declarations and script / style contents are never displayed, so rather than
+// tokenising them we just look for the terminator. The match can carry over between calls.
+// The closing tag of a script or style section is handed over to the tag parser as if it
+// had been read normally
+size_t HTMLParser::SkipToTerminator(const char* buffer, size_t count)
+{
+	const char* ptr = buffer;
+	const char* end = buffer + count;
 
-						const char* unicodeReplacement = GetUnicodeString(unicodePoint);
-						for (const char* s = unicodeReplacement; s && *s; s++)
-						{
-							ParseChar(*s);
-						}
-					}
-				}
+	while (ptr < end)
+	{
+		if (skipMatchLength == 0)
+		{
+			const char* start = (const char*) memchr(ptr, skipTerminator[0], end - ptr);
+			if (!start)
+			{
+				ptr = end;
 				break;
+			}
+			ptr = start + 1;
+			skipMatchLength = 1;
+		}
+		else if (tolower((unsigned char)*ptr) == skipTerminator[skipMatchLength])
+		{
+			ptr++;
+			skipMatchLength++;
+		}
+		else if (*ptr == skipTerminator[0] && skipTerminator[skipMatchLength - 1] == skipTerminator[0])
+		{
+			// Each terminator starts with a run of one character that doesn't appear again,
+			// so a repeat of it keeps the partial match, e.g. "--->" still ends a comment
+			ptr++;
+		}
+		else
+		{
+			// Not the terminator. Don't consume this character as it may be the start of one
+			skipMatchLength = 0;
+		}
 
-			case TextEncoding::ISO_8859_1:
-				for (const char* s = ISO_8859_1_Encoding.replacement[(unsigned char)c - 128]; s && *s; s++)
-				{
-					ParseChar(*s);
-				}
-				break;
+		if (skipMatchLength && !skipTerminator[skipMatchLength])
+		{
+			skipMatchLength = 0;
+			if (parseState == ParseRawText)
+			{
+				parseState = ParseTag;
+				AppendTextBuffer(skipTerminator + 1, strlen(skipTerminator + 1));
+			}
+			else
+			{
+				parseState = ParseText;
+			}
+			break;
+		}
+	}
 
-			case TextEncoding::ISO_8859_2:
-				for (const char* s = ISO_8859_2_Encoding.replacement[(unsigned char)c - 128]; s && *s; s++)
-				{
-					ParseChar(*s);
-				}
+	utf8State = UTF8_ACCEPT;
+	return ptr - buffer;
+}
+
+void HTMLParser::Parse(char* buffer, size_t count)
+{
+	if (textRun.IsAllocated())
+	{
+		// Layout may have mapped other EMS pages in since the last call
+		textBuffer = textRun.Get<char*>();
+	}
+
+	while (count && MemoryManager::pageAllocator.GetError() == LinearAllocator::Error_None)
+	{
+		if (parseState == ParseRawText || parseState == ParseComment)
+		{
+			size_t skipLength = SkipToTerminator(buffer, count);
+			buffer += skipLength;
+			count -= skipLength;
+			continue;
+		}
+
+		if (parseState == ParseText)
+		{
+			size_t spanLength = ParseTextSpan(buffer, count);
+			buffer += spanLength;
+			count -= spanLength;
+
+			if (!count)
+			{
 				break;
 			}
 		}
+
+		char c = *buffer++;
+		count--;
+
+		if ((unsigned char)c > 127)
+		{
+			DecodeChar((unsigned char)c);
+		}
 		else
 		{
-			parsingUnicode = false;
+			utf8State = UTF8_ACCEPT;
 			ParseChar(c);
 		}
 	}
@@ -767,10 +1179,127 @@ void HTMLParser::Parse(char* buffer, size_t count)
 	}
 }
 
+// Turns a byte outside of the ASCII range into the font's code page. Single byte encodings
+// are a lookup in the table built by SetTextEncoding, UTF-8 goes through the decoder DFA
+void HTMLParser::DecodeChar(unsigned char c)
+{
+	const char* replacement;
+
+	if (textEncoding == TextEncoding::UTF8)
+	{
+		uint8_t charClass = utf8CharClass[c];
+		if (utf8State == UTF8_REJECT)
+		{
+			utf8State = UTF8_ACCEPT;
+		}
+		utf8CodePoint = (utf8State != UTF8_ACCEPT) ? (c & 0x3f) | (utf8CodePoint << 6) : (0xff >> charClass) & c;
+		utf8State = utf8Transition[utf8State + charClass];
+
+		if (utf8State == UTF8_REJECT && charClass != 1 && charClass != 7 && charClass != 9)
+		{
+			// A lead byte cut the previous sequence short, so start again from this byte
+			utf8CodePoint = (0xff >> charClass) & c;
+			utf8State = utf8Transition[charClass];
+		}
+		if (utf8State != UTF8_ACCEPT)
+		{
+			return;
+		}
+		replacement = GetUnicodeString(utf8CodePoint);
+	}
+	else
+	{
+		replacement = byteReplacement[c - 128];
+	}
+
+	while (*replacement)
+	{
+		ParseChar(*replacement++);
+	}
+}
+
 void HTMLParser::SetTextEncoding(TextEncoding::Type newType)
 {
+	SingleByteCodePage* codePage = NULL;
+
+	switch (newType)
+	{
+	case TextEncoding::ISO_8859_1:
+	case TextEncoding::Windows_1252:
+		codePage = &Windows_1252_CodePage;
+		break;
+	case TextEncoding::ISO_8859_2:
+		codePage = &ISO_8859_2_CodePage;
+		break;
+	case TextEncoding::ISO_8859_15:
+		codePage = &ISO_8859_15_CodePage;
+		break;
+	case TextEncoding::Windows_1250:
+		codePage = &Windows_1250_CodePage;
+		break;
+	default:
+		break;
+	}
+
+	if (codePage)
+	{
+		// Resolve the font string for every byte up front so decoding is a single lookup
+		for (int n = 0; n < 128; n++)
+		{
+			uint16_t codePoint = codePage->codePoint[n];
+			byteReplacement[n] = codePoint ? GetUnicodeString(codePoint) : "";
+		}
+	}
+
 	textEncoding = newType;
-	parsingUnicode = false;
+	utf8State = UTF8_ACCEPT;
+}
+
+struct TextEncodingName
+{
+	const char* name;
+	TextEncoding::Type encoding;
+};
+
+static const TextEncodingName textEncodingNames[] =
+{
+	{ "utf-8", TextEncoding::UTF8 },
+	{ "utf8", TextEncoding::UTF8 },
+	{ "iso-8859-1", TextEncoding::ISO_8859_1 },
+	{ "iso8859-1", TextEncoding::ISO_8859_1 },
+	{ "latin1", TextEncoding::ISO_8859_1 },
+	{ "us-ascii", TextEncoding::ISO_8859_1 },
+	{ "iso-8859-2", TextEncoding::ISO_8859_2 },
+	{ "iso8859-2", TextEncoding::ISO_8859_2 },
+	{ "latin2", TextEncoding::ISO_8859_2 },
+	{ "iso-8859-15", TextEncoding::ISO_8859_15 },
+	{ "iso8859-15", TextEncoding::ISO_8859_15 },
+	{ "latin9", TextEncoding::ISO_8859_15 },
+	{ "windows-1250", TextEncoding::Windows_1250 },
+	{ "cp1250", TextEncoding::Windows_1250 },
+	{ "windows-1252", TextEncoding::Windows_1252 },
+	{ "cp1252", TextEncoding::Windows_1252 }
+};
+
+#define NUM_TEXT_ENCODING_NAMES (sizeof(textEncodingNames) / sizeof(TextEncodingName))
+
+// Sets the encoding from a charset label. The label may be followed by other parameters,
+// e.g. when it comes from a content type. Returns false if the label isn't recognised
+bool HTMLParser::SetTextEncoding(const char* name)
+{
+	for (unsigned int n = 0; n < NUM_TEXT_ENCODING_NAMES; n++)
+	{
+		const char* label = textEncodingNames[n].name;
+		size_t length = strlen(label);
+
+		if (!strnicmp(name, label, length) && !isalnum((unsigned char)name[length]) && name[length] != '-' && name[length] != '_')
+		{
+			SetTextEncoding(textEncodingNames[n].encoding);
+			return true;
+		}
+	}
+
+	return false;
 }
 
 void HTMLParser::PushPreFormatted()
@@ -864,15 +1393,38 @@ void HTMLParser::ParseChar(char c)
 		{
 			FlushTextBuffer();
 			parseState = ParseText;
+
+			switch (CurrentSection())
+			{
+			case SectionElement::Script:
+				BeginSkip(ParseRawText, "</script");
+				break;
+			case SectionElement::Style:
+				BeginSkip(ParseRawText, "</style");
+				break;
+			default:
+				break;
+			}
 		}
 		else
 		{
 			AppendTextBuffer(c);
 
-			if (textBufferSize == 3 && textBuffer[0] == '!' && textBuffer[1] == '-' && textBuffer[2] == '-')
+			// Comments, CDATA sections and declarations such as <!DOCTYPE> are skipped without being buffered
+			if (textBuffer[0] == '!')
 			{
-				parseState = ParseComment;
-				textBufferSize = 0;
+				if (textBufferSize == 3 && !strncmp(textBuffer, "!--", 3))
+				{
+					BeginSkip(ParseComment, "-->");
+				}
+				else if (textBufferSize == 8 && !strncmp(textBuffer, "![CDATA[", 8))
+				{
+					BeginSkip(ParseComment, "]]>");
+				}
+				else if (strncmp(textBuffer, "!--", textBufferSize) && strncmp(textBuffer, "![CDATA[", textBufferSize))
+				{
+					BeginSkip(ParseComment, ">");
+				}
 			}
 
 			// Special case when parsing script tags : we just want to look for a script closing tag
@@ -896,24 +1448,18 @@ void HTMLParser::ParseChar(char c)
 
 			parseState = ParseText;
 		}
-		break;
-
-		case ParseComment:
-		if (c == '-')
-		{
-			if (textBufferSize < 2)
-			{
-				textBuffer[textBufferSize++] = c;
-			}
-		}
-		else if (c == '>' && textBufferSize == 2)
+		else if (textBufferSize - escapeSequenceStartIndex > MAX_ESCAPE_SEQUENCE_LENGTH)
 		{
-			textBufferSize = 0;
 			parseState = ParseText;
 		}
-		else
+		break;
+
+		case ParseComment:
+		case ParseRawText:
+		if (!SkipToTerminator(&c, 1))
 		{
-			textBufferSize = 0;
+			// Broke off a partial match, so look at the character again from the start
+			SkipToTerminator(&c, 1);
 		}
 		break;
 
@@ -947,20 +1493,99 @@ void HTMLParser::ParseChar(char c)
 	
 }
 
-// Making this static as we only ever have one attribute parser running at a time
-// and we don't want to blow the stack with a huge buffer
-char AttributeParser::attributeStringBuffer[MAX_ATTRIBUTE_STRING_LENGTH];
+struct AttributeKeyName
+{
+	const char* name;
+	AttributeKey::Id id;
+};
+
+static const AttributeKeyName attributeKeyNames[] =
+{
+	{ "action",			AttributeKey::Action },
+	{ "align",			AttributeKey::Align },
+	{ "alt",			AttributeKey::Alt },
+	{ "bgcolor",		AttributeKey::BgColor },
+	{ "border",			AttributeKey::Border },
+	{ "cellpadding",	AttributeKey::CellPadding },
+	{ "cellspacing",	AttributeKey::CellSpacing },
+	{ "charset",		AttributeKey::Charset },
+	{ "checked",		AttributeKey::Checked },
+	{ "color",			AttributeKey::Color },
+	{ "colspan",		AttributeKey::ColSpan },
+	{ "content",		AttributeKey::Content },
+	{ "height",			AttributeKey::Height },
+	{ "href",			AttributeKey::Href },
+	{ "ismap",			AttributeKey::IsMap },
+	{ "link",			AttributeKey::Link },
+	{ "method",			AttributeKey::Method },
+	{ "name",			AttributeKey::Name },
+	{ "selected",		AttributeKey::Selected },
+	{ "size",			AttributeKey::Size },
+	{ "src",			AttributeKey::Src },
+	{ "text",			AttributeKey::Text },
+	{ "type",			AttributeKey::Type },
+	{ "value",			AttributeKey::Value },
+	{ "width",			AttributeKey::Width },
+};
+
+#define NUM_ATTRIBUTE_KEY_NAMES (sizeof(attributeKeyNames) / sizeof(AttributeKeyName))
+
+AttributeParser::AttributeParser(char* inAttributeString, bool semiColonAsDivider)
+: key(NULL)
+, value(NULL)
+, keyId(AttributeKey::Unknown)
+, attributeString(inAttributeString)
+, useSemiColonAsDivider(semiColonAsDivider)
+, keyTerminator(NULL)
+, valueTerminator(NULL)
+{
+}
+
+AttributeParser::~AttributeParser()
+{
+	RestoreTerminators();
+}
+
+void AttributeParser::Terminate(char* position, char*& terminator, char& replacedChar)
+{
+	terminator = position;
+	replacedChar = *position;
+	*position = '\0';
+}
 
-AttributeParser::AttributeParser(const char* inAttributeString, bool semiColonAsDivider) :key(NULL), value(NULL), useSemiColonAsDivider(semiColonAsDivider)
+void AttributeParser::RestoreTerminators()
 {
-	strncpy(attributeStringBuffer, inAttributeString, MAX_ATTRIBUTE_STRING_LENGTH);
-	attributeStringBuffer[MAX_ATTRIBUTE_STRING_LENGTH - 1] = '\0';
-	attributeString = attributeStringBuffer;
+	if (valueTerminator)
+	{
+		*valueTerminator = valueTerminatorChar;
+		valueTerminator = NULL;
+	}
+	if (keyTerminator)
+	{
+		*keyTerminator = keyTerminatorChar;
+		keyTerminator = NULL;
+	}
+}
+
+AttributeKey::Id AttributeParser::LookupKey(const char* key)
+{
+	// Most keys are rejected on the first character so this stays cheap for unknown keys
+	char first = (char)tolower((unsigned char)*key);
+	for (unsigned int n = 0; n < NUM_ATTRIBUTE_KEY_NAMES; n++)
+	{
+		if (attributeKeyNames[n].name[0] == first && !stricmp(attributeKeyNames[n].name, key))
+		{
+			return attributeKeyNames[n].id;
+		}
+	}
+	return AttributeKey::Unknown;
 }
 
 bool AttributeParser::Parse()
 {
+	RestoreTerminators();
 	key = value = NULL;
+	keyId = AttributeKey::Unknown;
 
 	// Skip any white space
 	while(*attributeString && IsWhiteSpace(*attributeString))
@@ -987,7 +1612,7 @@ bool AttributeParser::Parse()
 			}
 			attributeString++;
 		}
-		*attributeString = '\0';
+		Terminate(attributeString, keyTerminator, keyTerminatorChar);
 		attributeString++;
 	}
 	else if (*attributeString == '\'')
@@ -1002,7 +1627,7 @@ bool AttributeParser::Parse()
 			}
 			attributeString++;
 		}
-		*attributeString = '\0';
+		Terminate(attributeString, keyTerminator, keyTerminatorChar);
 		attributeString++;
 	}
 	else
@@ -1014,6 +1639,7 @@ bool AttributeParser::Parse()
 			{
 				// Key but no value
 				value = attributeString;
+				keyId = LookupKey(key);
 				return true;
 			}
 			if(*attributeString == '=')
@@ -1023,9 +1649,11 @@ bool AttributeParser::Parse()
 			}
 			attributeString++;
 		}
-		*attributeString = '\0';
+		Terminate(attributeString, keyTerminator, keyTerminatorChar);
 		attributeString++;
 	}
+
+	keyId = LookupKey(key);
 	
 	// Parse =
 	while(!foundEquals)
@@ -1072,7 +1700,7 @@ bool AttributeParser::Parse()
 			}
 			attributeString++;
 		}
-		*attributeString = '\0';
+		Terminate(attributeString, valueTerminator, valueTerminatorChar);
 		attributeString++;
 	}
 	else if (*attributeString == '\'')
@@ -1087,7 +1715,7 @@ bool AttributeParser::Parse()
 			}
 			attributeString++;
 		}
-		*attributeString = '\0';
+		Terminate(attributeString, valueTerminator, valueTerminatorChar);
 		attributeString++;
 	}
 	else
@@ -1100,7 +1728,7 @@ bool AttributeParser::Parse()
 		
 		if(*attributeString)
 		{
-			*attributeString = '\0';
+			Terminate(attributeString, valueTerminator, valueTerminatorChar);
 			attributeString++;
 		}
 	}
@@ -1187,7 +1815,6 @@ uint8_t HTMLParser::ParseColourCode(const char* colourCode)
 
 bool HTMLParser::SetContentType(const char* contentType)
 {
-	AttributeParser contentTypeParser(contentType, true);
 	bool isSupportedFormat = false;
 
 	if (strlen(contentType) == 0)
@@ -1196,26 +1823,28 @@ bool HTMLParser::SetContentType(const char* contentType)
 		return true;
 	}
 
+	// The attribute parser works in place so needs a writable copy. The copy is kept so a page
+	// that sets the content type again, e.g. from a header and then a meta tag, can reuse it
+	size_t length = strlen(contentType);
+	if (length >= contentTypeCapacity)
+	{
+		contentTypeString = (char*) MemoryManager::pageAllocator.Allocate(length + 1);
+		if (!contentTypeString)
+		{
+			contentTypeCapacity = 0;
+			return false;
+		}
+		contentTypeCapacity = length + 1;
+	}
+	strcpy(contentTypeString, contentType);
+
+	AttributeParser contentTypeParser(contentTypeString, true);
+
 	while (contentTypeParser.Parse())
 	{
-		if (!stricmp(contentTypeParser.Key(), "charset"))
+		if (contentTypeParser.KeyId() == AttributeKey::Charset)
 		{
-			if (!stricmp(contentTypeParser.Value(), "utf-8"))
-			{
-				SetTextEncoding(TextEncoding::UTF8);
-			}
-			else if (!stricmp(contentTypeParser.Value(), "ISO-8859-1"))
-			{
-				SetTextEncoding(TextEncoding::ISO_8859_1);
-			}
-			else if (!stricmp(contentTypeParser.Value(), "ISO-8859-2"))
-			{
-				SetTextEncoding(TextEncoding::ISO_8859_2);
-			}
-			else if (!stricmp(contentTypeParser.Value(), "Windows-1252"))
-			{
-				SetTextEncoding(TextEncoding::ISO_8859_1);
-			}
+			SetTextEncoding(contentTypeParser.Value());
 		}
 		else if (!stricmp(contentTypeParser.Key(), "text/plain"))
 		{
@@ -18,6 +18,7 @@
 #include <stdint.h>
 #include "Nodes/Section.h"
 #include "Stack.h"
+#include "Memory/MemBlock.h"
 
 class Page;
 class Node;
@@ -30,37 +31,105 @@ struct TextEncoding
 	{
 		UTF8,
 		ISO_8859_1,
-		ISO_8859_2
+		ISO_8859_2,
+		ISO_8859_15,
+		Windows_1250,
+		Windows_1252
 	};
 };
 
 struct HTMLParseContext
 {
 	Node* node;
+	Node* lastChild;			// Last child added to node, so that appending doesn't walk the sibling list
 	const HTMLTagHandler* tag;
 	SectionElement::Type parseSection;
+
+	// Innermost open elements that the parser needs to know about. These are inherited from
+	// the enclosing context when a context is pushed so they can be checked without a stack walk
+	Node* optionNode;
+	Node* buttonNode;
+	Node* tableNode;
+	Node* tableCellNode;		// Only set if the cell is inside tableNode
 };
 
-#define MAX_ATTRIBUTE_STRING_LENGTH 1024
+// Size of the per tag open element counters, must be more than the number of tag handlers
+#define MAX_TAG_HANDLERS 64
+
+// Body text is streamed straight into the block that the text node will own. The run keeps
+// doubling until it reaches the largest block its backing store can hold (see
+// MemBlockAllocator::MaxGrowableSize), so a paragraph is only split beyond that
+#define TEXT_RUN_INITIAL_SIZE 128
+
+// Longer than any entity we recognise, so the sequence is left as plain text
+#define MAX_ESCAPE_SEQUENCE_LENGTH 32
 
+// Attribute keys that tag handlers act on, so they can switch on the key instead of comparing strings
+struct AttributeKey
+{
+	enum Id
+	{
+		Unknown,
+		Action,
+		Align,
+		Alt,
+		BgColor,
+		Border,
+		CellPadding,
+		CellSpacing,
+		Charset,
+		Checked,
+		Color,
+		ColSpan,
+		Content,
+		Height,
+		Href,
+		IsMap,
+		Link,
+		Method,
+		Name,
+		Selected,
+		Size,
+		Src,
+		Text,
+		Type,
+		Value,
+		Width
+	};
+};
+
+// Tokenises the attribute string in place. Key() and Value() are null terminated by temporarily
+// overwriting the character that follows them, which is put back on the next call to Parse()
+// and when the parser goes out of scope, so the string can be parsed again afterwards
 class AttributeParser
 {
 public:
-	AttributeParser(const char* inAttributeString, bool useSemiColonAsDivider = false);
+	AttributeParser(char* inAttributeString, bool useSemiColonAsDivider = false);
+	~AttributeParser();
 	bool Parse();
 	
+	AttributeKey::Id KeyId() { return keyId; }
 	const char* Key() { return key; }
 	const char* Value() { return value; }
 	int ValueAsInt() { return atoi(value); }
+	bool ValueIs(const char* str) { return !stricmp(value, str); }
 	
 private:
 	bool IsWhiteSpace(char c);
+	void Terminate(char* position, char*& terminator, char& replacedChar);
+	void RestoreTerminators();
+	static AttributeKey::Id LookupKey(const char* key);
 	
-	static char attributeStringBuffer[MAX_ATTRIBUTE_STRING_LENGTH];
 	char* key;
 	char* value;
+	AttributeKey::Id keyId;
 	char* attributeString;
 	bool useSemiColonAsDivider;
+
+	char* keyTerminator;
+	char keyTerminatorChar;
+	char* valueTerminator;
+	char valueTerminatorChar;
 };
 
 class HTMLParser
@@ -79,13 +148,13 @@ public:
 	void PopContext(const HTMLTagHandler* tag);
 	HTMLParseContext& CurrentContext() { return contextStack.Top(); }
 	SectionElement::Type CurrentSection() { return CurrentContext().parseSection; }
-	HTMLParseContext* FindContextInStack(Node::Type nodeType);
 
 	void EmitNode(Node* node);
 	void EmitText(const char* text);
 	void EmitImage(Image* image, int imageWidth, int imageHeight);
 
 	void SetTextEncoding(TextEncoding::Type newType);
+	bool SetTextEncoding(const char* name);
 
 	void PushPreFormatted();
 	void PopPreFormatted();
@@ -93,21 +162,40 @@ public:
 	static uint8_t ParseColourCode(const char* colourCode);
 
 	static void ReplaceAmpersandEscapeSequences(char* buffer, bool replaceNonBreakingSpace = true);
-	static const char* GetUnicodeString(int codePoint);
+	static const char* GetUnicodeString(uint32_t codePoint);
+	static const char* DecodeEscapeSequence(const char* sequence, int sequenceLength);
 
 	void Finish();
 	bool IsFinished() { return parseState == ParseFinished; }
 
 private:
 	void ParseChar(char c);
+	void DecodeChar(unsigned char c);
+	size_t ParseTextSpan(const char* buffer, size_t count);
 
 	//HTMLNode* CreateNode(HTMLNode::NodeType nodeType, HTMLNode* parentNode);
 	void AppendTextBuffer(char c);
+	void AppendTextBuffer(const char* text, size_t length);
 	void FlushTextBuffer();
+	bool IsTextRunDestination();
+	void BeginTextRun();
+	void KeepSpareTextRun(MemBlockHandle run, size_t size);
+	bool GrowTextBuffer();
+	void EmitTextRun();
 	static bool IsWhiteSpace(char c);
 
 	void DebugDumpNodeGraph(Node* node, int depth = 0);
 
+	enum TextCharClass
+	{
+		TextChar_Plain,
+		TextChar_WhiteSpace,
+		TextChar_Special
+	};
+
+	static void InitTextCharClasses();
+	static uint8_t textCharClass[256];
+
 	enum ParseState
 	{
 		ParseText,
@@ -116,22 +204,37 @@ private:
 		ParseAmpersandEscape,
 		ParseComment,
 		ParseFinished,
-		ParsePlainText
+		ParsePlainText,
+		ParseRawText
 	};
+
+	size_t SkipToTerminator(const char* buffer, size_t count);
+	void BeginSkip(ParseState state, const char* terminator);
 	
 	ParseState parseState;
-	char textBuffer[2560];
+	char* textBuffer;				// Either fixedTextBuffer or the storage for textRun
 	size_t textBufferSize;
+	size_t textBufferCapacity;
+	char fixedTextBuffer[2560];
+	MemBlockHandle textRun;
+	MemBlockHandle spareTextRun;	// Block left behind when a run had to move, reused by the next run
+	size_t spareTextRunSize;
 	int escapeSequenceStartIndex;
+
+	char* contentTypeString;		// Writable copy of the last content type, reused while it fits
+	size_t contentTypeCapacity;
+
+	const char* skipTerminator;		// Lower case string that ends a comment, declaration or script / style section
+	int skipMatchLength;
 	
 	Stack<HTMLParseContext> contextStack;
 	int contextStackSize;
-
-	bool parsingUnicode;
-	int unicodeByteCount;
-	uint32_t unicodePoint;
+	uint16_t openTagCount[MAX_TAG_HANDLERS];
 
 	TextEncoding::Type textEncoding;
+	const char* byteReplacement[128];	// Font string for each upper half byte of a single byte encoding
+	uint8_t utf8State;
+	uint32_t utf8CodePoint;
 
 	unsigned int preformatted;
 };
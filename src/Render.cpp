@@ -5,14 +5,22 @@
 #include "Draw/Surface.h"
 #include "DataPack.h"
 #include "Nodes/ImgNode.h"
+#include "Memory/Memory.h"
 
 PageRenderer::PageRenderer(App& inApp)
 	: app(inApp)
+	, priorityNode(nullptr)
 {
 }
 
 void PageRenderer::Init()
 {
+	if (App::config.useScrollCache)
+	{
+		Rect& windowRect = app.ui.windowRect;
+		scrollCache.Init(Platform::video->drawSurface, windowRect);
+	}
+
 	Reset();
 }
 
@@ -55,7 +63,10 @@ void PageRenderer::RefreshAll()
 
 	Platform::input->ShowMouse();
 
-	renderQueue.Reset();
+	renderQueue.Clear();
+	damage.Clear();
+	scrollCache.Clear();
+	missedUpperClip = missedLowerClip = 0;
 
 	FindOverlappingNodesInScreenRegion(windowRect.y, windowRect.y + windowRect.height);
 }
@@ -72,13 +83,7 @@ void PageRenderer::MarkScreenRegionDirty(int left, int top, int right, int botto
 	if (right > windowRect.x + windowRect.width)
 		right = windowRect.x + windowRect.width;
 
-	DrawContext clearContext;
-	InitContext(clearContext);
-	clearContext.drawOffsetY = 0;
-
-	Platform::input->HideMouse();
-	clearContext.surface->FillRect(clearContext, left, top, right - left, bottom - top, app.page.colourScheme.pageColour);
-	Platform::input->ShowMouse();
+	AddDamage(left, top, right, bottom);
 
 	FindOverlappingNodesInScreenRegion(top, bottom);
 }
@@ -98,42 +103,17 @@ void PageRenderer::OnPageScroll(int scrollDelta)
 	int minWinX = windowRect.x;
 	int maxWinX = windowRect.x + windowRect.width;
 
-	for (int i = renderQueue.head; i < renderQueue.tail; i++)
-	{
-		RenderQueue::Item* item = &renderQueue.items[i];
-		item->lowerClip -= scrollDelta;
-		item->upperClip -= scrollDelta;
-
-		if (item->upperClip < minWinY)
-			item->upperClip = minWinY;
-		if (item->lowerClip > maxWinY)
-			item->lowerClip = maxWinY;
-
-		if (item->lowerClip <= item->upperClip)
-		{
-			// Scrolled off screen, can remove from queue
-			renderQueue.tail--;
-			for (int n = i; n < renderQueue.tail; n++)
-			{
-				renderQueue.items[n] = renderQueue.items[n + 1];
-			}
-			i--;
-		}
-	}
+	renderQueue.Scroll(scrollDelta, minWinY, maxWinY);
+	damage.Scroll(scrollDelta, minWinY, maxWinY);
 
-	if (scrollDelta > 0)
+	if (missedLowerClip > missedUpperClip)
 	{
-		int top = maxWinY - scrollDelta;
-		if (top < minWinY)
-			top = minWinY;
-		FindOverlappingNodesInScreenRegion(top, maxWinY);
-	}
-	else if (scrollDelta < 0)
-	{
-		int bottom = minWinY - scrollDelta;
-		if (bottom > maxWinY)
-			bottom = maxWinY;
-		FindOverlappingNodesInScreenRegion(minWinY, bottom);
+		missedUpperClip -= scrollDelta;
+		missedLowerClip -= scrollDelta;
+		if (missedUpperClip < minWinY)
+			missedUpperClip = minWinY;
+		if (missedLowerClip > maxWinY)
+			missedLowerClip = maxWinY;
 	}
 
 	Platform::input->HideMouse();
@@ -164,9 +144,79 @@ void PageRenderer::OnPageScroll(int scrollDelta)
 		clearContext.surface->FillRect(clearContext, 0, 0, Platform::video->screenWidth, Platform::video->screenHeight, app.page.colourScheme.pageColour);
 	}
 
+	ShowExposedScreenRegion(clearContext.clipTop, clearContext.clipBottom);
+
 	Platform::input->ShowMouse();
 }
 
+// Fills in a strip of the window that has just been scrolled into view, copying from the
+// scroll cache where it can and queueing the nodes for drawing everywhere else
+void PageRenderer::ShowExposedScreenRegion(int top, int bottom)
+{
+	CheckScrollCacheIsCurrent();
+
+	if (!scrollCache.IsEnabled())
+	{
+		FindOverlappingNodesInScreenRegion(top, bottom);
+		return;
+	}
+
+	DrawSurface* surface = Platform::video->drawSurface;
+	int drawOffsetY = GetDrawOffsetY();
+	int bandHeight = scrollCache.GetBandHeight();
+	int lineBytes = scrollCache.GetLineBytes();
+	int lineOffset = scrollCache.GetLineOffset();
+	int y = top;
+
+	while (y < bottom)
+	{
+		int index = (int)(((long) y - drawOffsetY) / bandHeight);
+		long bandScreenTop = (long) index * bandHeight + drawOffsetY;
+		int segmentBottom = bandScreenTop + bandHeight < bottom ? (int)(bandScreenTop + bandHeight) : bottom;
+
+		ScrollCache::Band* band = scrollCache.Find(index);
+		uint8_t* data = band ? band->data.Get<uint8_t*>() : nullptr;
+
+		if (data)
+		{
+			data += (y - bandScreenTop) * lineBytes;
+			for (int line = y; line < segmentBottom; line++)
+			{
+				memcpy(surface->lines[line] + lineOffset, data, lineBytes);
+				data += lineBytes;
+			}
+		}
+		else
+		{
+			FindOverlappingNodesInScreenRegion(y, segmentBottom);
+		}
+
+		y = segmentBottom;
+	}
+}
+
+// Containers that don't draw anything themselves are left out of the band index, otherwise
+// the body and any other enclosing blocks would be in every band
+bool PageRenderer::IsIndexedNode(Node* node)
+{
+	if (!IsRenderableNode(node) || node->size.y <= 0)
+		return false;
+
+	switch (node->type)
+	{
+	case Node::Block:
+	case Node::TableRow:
+	case Node::List:
+	case Node::Option:
+		return false;
+	case Node::Text:
+		// Wrapped text is drawn by its SubText children
+		return !node->firstChild;
+	default:
+		return true;
+	}
+}
+
 bool PageRenderer::IsRenderableNode(Node* node)
 {
 	if (node->size.IsZero())
@@ -191,44 +241,127 @@ int PageRenderer::GetDrawOffsetY()
 }
 
 void PageRenderer::FindOverlappingNodesInScreenRegion(int top, int bottom)
+{
+	FindOverlappingNodesInRegion(top, bottom, GetDrawOffsetY());
+}
+
+void PageRenderer::FindOverlappingNodesInRegion(int top, int bottom, int drawOffsetY)
 {
 	Rect& windowRect = app.ui.windowRect;
-	int drawOffsetY = GetDrawOffsetY();
 
 	if (top < windowRect.y)
 		top = windowRect.y;
 	if (bottom > windowRect.y + windowRect.height)
 		bottom = windowRect.y + windowRect.height;
 
-	if (!lastCompleteNode)
+	if (!lastCompleteNode || bottom <= top)
 		return;
 
-	for(Node* node = app.page.GetRootNode(); node; node = node->GetNextInTree())
+	if (!bandIndex.IsValid())
 	{
-		if(IsRenderableNode(node))
+		// Not everything made it into the band index so fall back to checking every node
+		for (Node* node = app.page.GetRootNode(); node; node = node->GetNextInTree())
 		{
-			int nodeTop = node->anchor.y + drawOffsetY;
-			int nodeBottom = nodeTop + node->size.y;
+			if (IsRenderableNode(node))
+			{
+				QueueNodeInRegion(node, top, bottom, drawOffsetY);
+			}
+
+			if (node == lastCompleteNode)
+				break;
+		}
+		return;
+	}
+
+	int firstBand = RenderBandIndex::GetBandIndex((long) top - drawOffsetY);
+	int lastBand = RenderBandIndex::GetBandIndex((long) bottom - 1 - drawOffsetY);
+
+	for (int index = firstBand; index <= lastBand; index++)
+	{
+		RenderBand* band = bandIndex.GetBand(index);
+		if (!band)
+			continue;
 
-			if (nodeTop < top)
-				nodeTop = top;
-			if (nodeBottom > bottom)
-				nodeBottom = bottom;
+		for (RenderBandBlock* block = band->first; block; block = block->next)
+		{
+			int count = block == band->last ? band->lastCount : RENDER_BAND_BLOCK_SIZE;
 
-			if(nodeBottom - nodeTop > 0)
+			for (int n = 0; n < count; n++)
 			{
-				AddToQueue(node, nodeTop, nodeBottom);
+				Node* node = block->nodes[n].Get();
+
+				// Nodes that span several bands were already seen in the first band they share with the region
+				if (index > firstBand && RenderBandIndex::GetBandIndex(node->anchor.y) < index)
+					continue;
+
+				QueueNodeInRegion(node, top, bottom, drawOffsetY);
 			}
+
+			if (block == band->last)
+				break;
 		}
+	}
+}
 
-		if (node == lastCompleteNode)
-			break;
+void PageRenderer::QueueNodeInRegion(Node* node, int top, int bottom, int drawOffsetY)
+{
+	int nodeTop = node->anchor.y + drawOffsetY;
+	int nodeBottom = nodeTop + node->size.y;
+
+	if (nodeTop < top)
+		nodeTop = top;
+	if (nodeBottom > bottom)
+		nodeBottom = bottom;
+
+	if (nodeBottom - nodeTop > 0)
+	{
+		AddToQueue(node, nodeTop, nodeBottom);
+	}
+}
+
+void PageRenderer::AddDamage(int left, int top, int right, int bottom)
+{
+	if (!damage.Add(left, top, right, bottom))
+	{
+		// Out of space so clear what we have now and start again
+		Platform::input->HideMouse();
+		ClearDamagedRegions();
+		Platform::input->ShowMouse();
+
+		damage.Add(left, top, right, bottom);
+	}
+}
+
+void PageRenderer::ClearDamagedRegions()
+{
+	if (!damage.Count())
+	{
+		return;
 	}
+
+	DrawContext clearContext;
+	InitContext(clearContext);
+	clearContext.drawOffsetX = 0;
+	clearContext.drawOffsetY = 0;
+
+	for (int n = 0; n < damage.Count(); n++)
+	{
+		DamageTracker::Region& region = damage.Get(n);
+		clearContext.surface->FillRect(clearContext, region.left, region.top, region.right - region.left, region.bottom - region.top, app.page.colourScheme.pageColour);
+	}
+
+	damage.Clear();
 }
 
 void PageRenderer::Reset()
 {
 	renderQueue.Reset();
+	damage.Clear();
+	scrollCache.Reset();
+	missedUpperClip = missedLowerClip = 0;
+	priorityNode = nullptr;
+	bandIndex.Reset();
+	pickIndex.Reset();
 	lastCompleteNode = nullptr;
 	visiblePageHeight = 0;
 	isPaused = false;
@@ -260,9 +393,24 @@ void PageRenderer::Update()
 	//if (rand() % 256)
 	//	return;
 #endif
-	if (isPaused || renderQueue.Size() == 0)
+	if (isPaused)
 		return;
 
+	if (!renderQueue.Front() && missedLowerClip > missedUpperClip)
+	{
+		// Memory may have been freed up since, so try queueing the region that was missed again
+		int top = missedUpperClip;
+		int bottom = missedLowerClip;
+		missedUpperClip = missedLowerClip = 0;
+		FindOverlappingNodesInScreenRegion(top, bottom);
+	}
+
+	if (!renderQueue.Front() && !damage.Count())
+	{
+		FillScrollCache();
+		return;
+	}
+
 	clock_t maxRenderTime = clock() + UPDATE_TIME_SLICE;
 
 	DrawContext itemContext;
@@ -272,37 +420,56 @@ void PageRenderer::Update()
 
 	Platform::input->HideMouse();
 
-	while(renderQueue.Size())
+	ClearDamagedRegions();
+
+	while(renderQueue.Front())
 	{
-		RenderQueue::Item* item = &renderQueue.items[renderQueue.head];
-		Node* toRender = item->node;
+		RenderQueue::Item* item = renderQueue.Front();
+		Node* toRender = item->node.Get();
 		bool finishedRendering = true;
 
 		itemContext.clipTop = item->upperClip;
 		itemContext.clipBottom = item->lowerClip;
 		
+		bool isImageSlice = false;
+
 		if (toRender->type == Node::Image)
 		{
 			// Render images bit by bit
-			const int imageLinesToRenderPerUpdate = 16;
-
 			ImageNode::Data* imageData = static_cast<ImageNode::Data*>(toRender);
 			if (imageData->state == ImageNode::FinishedDownloadingContent && imageData->image.lines.IsAllocated())
 			{
-				if (itemContext.clipBottom > itemContext.clipTop + imageLinesToRenderPerUpdate)
+				int imageLinesToRender = imageSliceBudget.GetSliceLines(itemContext.surface->format, toRender->size.x, maxRenderTime - clock());
+				isImageSlice = true;
+
+				if (itemContext.clipBottom > itemContext.clipTop + imageLinesToRender)
 				{
-					itemContext.clipBottom = itemContext.clipTop + imageLinesToRenderPerUpdate;
+					itemContext.clipBottom = itemContext.clipTop + imageLinesToRender;
 					item->upperClip = itemContext.clipBottom;
 					finishedRendering = false;
 				}
 			}
 		}
 
-		toRender->Handler().Draw(itemContext, toRender);
+		if (isImageSlice)
+		{
+			clock_t drawStartTime = clock();
+			toRender->Handler().Draw(itemContext, toRender);
+			imageSliceBudget.AddSample(itemContext.surface->format, (long) toRender->size.x * (itemContext.clipBottom - itemContext.clipTop), clock() - drawStartTime);
+		}
+		else
+		{
+			toRender->Handler().Draw(itemContext, toRender);
+		}
 
-		if (finishedRendering)
+		if (!finishedRendering)
 		{
-			renderQueue.Dequeue();
+			// Let the rest of the queue have a turn so text isn't held up behind a large image
+			renderQueue.MoveFrontToBack();
+		}
+		else
+		{
+			renderQueue.RemoveFront();
 
 			if (Platform::input->HasInputPending())
 			{
@@ -320,92 +487,61 @@ void PageRenderer::Update()
 	Platform::input->ShowMouse();
 }
 
-void PageRenderer::AddToQueue(Node* node, int upperClip, int lowerClip)
+// Whatever the user is interacting with gets drawn ahead of the rest of the screen. The extent
+// of the focused node is only found when focus changes, so most nodes are ruled out by their
+// position without walking up the tree
+bool PageRenderer::IsPriorityNode(Node* node)
 {
-	if (lowerClip <= upperClip)
+	Node* focusedNode = app.ui.GetFocusedNode();
+	if (!focusedNode)
 	{
-		return;
+		return false;
+	}
+	if (node == focusedNode)
+	{
+		return true;
+	}
+
+	if (priorityNode != focusedNode)
+	{
+		Rect rect;
+		focusedNode->CalculateEncapsulatingRect(rect);
+		priorityNode = focusedNode;
+		priorityTop = rect.y;
+		priorityBottom = rect.y + rect.height;
 	}
 
-	int insertPosition = renderQueue.tail;
+	return node->anchor.y >= priorityTop && node->anchor.y <= priorityBottom && node->IsChildOf(focusedNode);
+}
 
-	// Check if in queue already
-	for (int i = renderQueue.head; i < renderQueue.tail; i++)
+void PageRenderer::AddToQueue(Node* node, int upperClip, int lowerClip)
+{
+	if (lowerClip <= upperClip)
 	{
-		RenderQueue::Item* item = &renderQueue.items[i];
-		if (item->node == node)
-		{
-			// Already in queue
-			if ((upperClip <= item->upperClip && lowerClip >= item->upperClip)
-				|| (lowerClip >= item->lowerClip && upperClip <= item->lowerClip))
-			{
-				// Grow clip region
-				if (upperClip < item->upperClip)
-				{
-					item->upperClip = upperClip;
-				}
-				if (lowerClip > item->lowerClip)
-				{
-					item->lowerClip = lowerClip;
-				}
-				return;
-			}
-		}
-		else if (item->node->IsChildOf(node))
-		{
-			if (insertPosition > i)
-			{
-				insertPosition = i;
-			}
-		}
+		return;
 	}
 
-	if (renderQueue.Size() < MAX_RENDER_QUEUE_SIZE)
+	if (!renderQueue.Add(node, upperClip, lowerClip, IsPriorityNode(node)))
 	{
-		if (renderQueue.tail == MAX_RENDER_QUEUE_SIZE)
+		// Out of memory: remember the region so that it can be queued again once the queue drains
+		if (missedLowerClip <= missedUpperClip)
 		{
-			memcpy(renderQueue.items, renderQueue.items + renderQueue.head, renderQueue.Size() * sizeof(RenderQueue::Item));
-			renderQueue.tail -= renderQueue.head;
-			insertPosition -= renderQueue.head;
-			renderQueue.head = 0;
+			missedUpperClip = upperClip;
+			missedLowerClip = lowerClip;
 		}
-
-		if (insertPosition != renderQueue.tail)
+		else
 		{
-			for (int i = renderQueue.tail; i > insertPosition; --i)
-			{
-				renderQueue.items[i] = renderQueue.items[i - 1];
-			}
+			if (upperClip < missedUpperClip)
+				missedUpperClip = upperClip;
+			if (lowerClip > missedLowerClip)
+				missedLowerClip = lowerClip;
 		}
-
-		RenderQueue::Item* item = &renderQueue.items[insertPosition];
-		item->node = node;
-		item->upperClip = upperClip;
-		item->lowerClip = lowerClip;
-		renderQueue.tail++;
-	}
-	else
-	{
-		//printf("Error! Out of space in render queue!\n");
 	}
 }
 
 bool PageRenderer::IsInRenderQueue(Node* node)
 {
-	if (!node)
-	{
-		return false;
-	}
-	for (int i = renderQueue.head; i < renderQueue.tail; i++)
-	{
-		RenderQueue::Item* item = &renderQueue.items[i];
-		if (item->node == node)
-		{
-			// Already in queue
-			return true;
-		}
-	}
-	return false;
+	return node && renderQueue.Contains(node);
 }
 
 void PageRenderer::DrawAll(DrawContext& context, Node* node)
@@ -446,47 +582,59 @@ void PageRenderer::GenerateDrawContext(DrawContext& context, Node* node)
 		context.clipBottom = windowRect.y + windowRect.height;
 		context.drawOffsetX = windowRect.x - app.ui.GetScrollPositionX();
 		context.drawOffsetY = windowRect.y - app.ui.GetScrollPositionY();
+
+		// Drawn straight to the screen because something about the node changed
+		InvalidateScrollCache(node);
 	}
 }
 
 void PageRenderer::MarkNodeLayoutComplete(Node* node)
 {
-	Rect& windowRect = app.ui.windowRect;
-	int drawOffsetY = GetDrawOffsetY();
-	Node* startNode = lastCompleteNode ? lastCompleteNode->GetNextInTree() : app.page.GetRootNode();
-	lastCompleteNode = node;
-
-	int minWinY = windowRect.y;
-	int maxWinY = windowRect.y + windowRect.height;
+	// Parents of the last completed node have been passed over already. They are added once
+	// the layout moves on past them, when their size is final
+	if (!node->isLayoutComplete)
+	{
+		CompleteNodesUpTo(node, false);
+	}
+}
 
+// Marks everything up to and including lastNode as complete. Unless the whole page is complete,
+// the parents of lastNode are still being laid out so they are left until a later call
+void PageRenderer::CompleteNodesUpTo(Node* lastNode, bool isPageComplete)
+{
 	bool expandedPage = false;
 
-	for (Node* node = startNode; node; node = node->GetNextInTree())
+	if (lastCompleteNode)
 	{
-		node->isLayoutComplete = true;
-
-		if (IsRenderableNode(node))
+		// Parents of the previous last node that don't contain this one are now finished
+		for (Node* node = lastCompleteNode->parent.Get(); node; node = node->parent.Get())
 		{
-			int nodeTop = node->anchor.y + drawOffsetY;
-			int nodeBottom = nodeTop + node->size.y;
+			if (!isPageComplete && lastNode->IsChildOf(node))
+				break;
 
-			if (node->anchor.y + node->size.y > visiblePageHeight)
+			if (AddCompletedNode(node))
 			{
-				visiblePageHeight = node->anchor.y + node->size.y;
 				expandedPage = true;
 			}
+		}
+	}
+
+	Node* startNode = lastCompleteNode ? lastCompleteNode->GetNextInTree() : app.page.GetRootNode();
+	lastCompleteNode = lastNode;
+
+	for (Node* node = startNode; node; node = node->GetNextInTree())
+	{
+		node->isLayoutComplete = true;
 
-			if (nodeTop < minWinY)
-				nodeTop = minWinY;
-			if (nodeBottom > maxWinY)
-				nodeBottom = maxWinY;
-			if (nodeBottom > nodeTop)
+		if (isPageComplete || !node->firstChild || !lastNode->IsChildOf(node))
+		{
+			if (AddCompletedNode(node))
 			{
-				AddToQueue(node, nodeTop, nodeBottom);
+				expandedPage = true;
 			}
 		}
 
-		if (node == lastCompleteNode)
+		if (node == lastNode)
 			break;
 	}
 
@@ -496,21 +644,47 @@ void PageRenderer::MarkNodeLayoutComplete(Node* node)
 	}
 }
 
+// Adds a node with its final layout to the band index and queues it if it is on screen.
+// Returns true if the visible page got longer
+bool PageRenderer::AddCompletedNode(Node* node)
+{
+	if (IsIndexedNode(node))
+	{
+		bandIndex.Add(node);
+	}
+
+	AddToPickIndex(node);
+
+	if (!IsRenderableNode(node))
+	{
+		return false;
+	}
+
+	Rect& windowRect = app.ui.windowRect;
+	int drawOffsetY = GetDrawOffsetY();
+	bool expandedPage = false;
+
+	if (node->anchor.y + node->size.y > visiblePageHeight)
+	{
+		visiblePageHeight = node->anchor.y + node->size.y;
+		expandedPage = true;
+	}
+
+	QueueNodeInRegion(node, windowRect.y, windowRect.y + windowRect.height, drawOffsetY);
+
+	return expandedPage;
+}
+
 void PageRenderer::MarkNodeDirty(Node* dirtyNode, int nodeDirtyTop, int nodeDirtyBottom)
 {
 	// Check this is in a completed layout
-	if (!app.page.layout.IsFinished())
+	if (!app.page.layout.IsFinished() && !dirtyNode->isLayoutComplete)
 	{
-		for (Node* node = app.page.GetRootNode(); node; node = node->GetNextInTree())
-		{
-			if (node == lastCompleteNode)
-				return;
-
-			if (node == dirtyNode)
-				break;
-		}
+		return;
 	}
 
+	InvalidateScrollCache(dirtyNode);
+
 	Rect& windowRect = app.ui.windowRect;
 	int drawOffsetY = GetDrawOffsetY();
 	int minWinY = windowRect.y;
@@ -542,26 +716,8 @@ void PageRenderer::MarkNodeDirty(Node* dirtyNode, int nodeDirtyTop, int nodeDirt
 			nodeBottom = maxWinY;
 		AddToQueue(dirtyNode, nodeTop, nodeBottom);
 
-		Platform::input->HideMouse();
-
-		Rect& windowRect = app.ui.windowRect;
-
-		DrawContext clearContext;
-		InitContext(clearContext);
-		clearContext.clipBottom = windowRect.y + windowRect.height;
-		clearContext.drawOffsetX = -app.ui.GetScrollPositionX();
-		clearContext.drawOffsetY = windowRect.y - app.ui.GetScrollPositionY();
-		
-		if (nodeDirtyTop >= 0 && nodeDirtyBottom >= 0)
-		{
-			clearContext.surface->FillRect(clearContext, dirtyNode->anchor.x, dirtyNode->anchor.y + nodeDirtyTop, dirtyNode->size.x, nodeDirtyBottom - nodeDirtyTop, app.page.colourScheme.pageColour);
-		}
-		else
-		{
-			clearContext.surface->FillRect(clearContext, dirtyNode->anchor.x, dirtyNode->anchor.y, dirtyNode->size.x, dirtyNode->size.y, app.page.colourScheme.pageColour);
-		}
-
-		Platform::input->ShowMouse();
+		int nodeLeft = dirtyNode->anchor.x - app.ui.GetScrollPositionX();
+		AddDamage(nodeLeft, nodeTop, nodeLeft + dirtyNode->size.x, nodeBottom);
 	}
 }
 
@@ -583,26 +739,266 @@ void PageRenderer::MarkPageLayoutComplete()
 		}
 		else
 		{
-			MarkNodeLayoutComplete(node);
+			CompleteNodesUpTo(node, true);
 			break;
 		}
 	}
 }
 
-void PageRenderer::InvertNode(Node* node)
+// Only the outermost pickable node is indexed since picking stops there. Nodes like links don't
+// have a size of their own so their area comes from their children
+void PageRenderer::AddToPickIndex(Node* node)
 {
-	Platform::input->HideMouse();
-	Rect& windowRect = app.ui.windowRect;
-	DrawContext invertContext;
+	if (!node->Handler().CanPick(node))
+		return;
 
-	InitContext(invertContext);
-	invertContext.clipBottom = windowRect.y + windowRect.height;
+	for (Node* parent = node->parent.Get(); parent; parent = parent->parent.Get())
+	{
+		if (parent->Handler().CanPick(parent))
+			return;
+	}
 
-	//if (invertContext.clipTop < upperContext.clipBottom)
-	//{
-	//	invertContext.clipTop = upperContext.clipBottom;
-	//}
-	//if (invertContext.clipBottom > lowerContext.clipTop)
+	if (!node->size.IsZero())
+	{
+		pickIndex.Add(node);
+		return;
+	}
+
+	Rect rect;
+	node->CalculateEncapsulatingRect(rect);
+
+	if (rect.height > 0)
+	{
+		pickIndex.Add(node, rect.y, (long) rect.y + rect.height);
+	}
+}
+
+// Finds the pickable node at a page position by only checking the nodes in the band it falls in
+Node* PageRenderer::PickNode(int x, int y)
+{
+	if (!pickIndex.IsValid())
+	{
+		Node* rootNode = app.page.GetRootNode();
+		return rootNode->Handler().Pick(rootNode, x, y);
+	}
+
+	RenderBand* band = pickIndex.GetBand(RenderBandIndex::GetBandIndex(y));
+	if (!band)
+		return nullptr;
+
+	for (RenderBandBlock* block = band->first; block; block = block->next)
+	{
+		int count = block == band->last ? band->lastCount : RENDER_BAND_BLOCK_SIZE;
+
+		for (int n = 0; n < count; n++)
+		{
+			Node* node = block->nodes[n].Get();
+			Node* result = node->Handler().Pick(node, x, y);
+			if (result)
+			{
+				return result;
+			}
+		}
+
+		if (block == band->last)
+			break;
+	}
+
+	return nullptr;
+}
+
+// Nodes have moved so the band indices are built again from the tree
+void PageRenderer::MarkPageRelaidOut()
+{
+	priorityNode = nullptr;
+	scrollCache.Clear();
+	bandIndex.Clear();
+	pickIndex.Clear();
+
+	if (!lastCompleteNode)
+		return;
+
+	for (Node* node = app.page.GetRootNode(); node; node = node->GetNextInTree())
+	{
+		if (IsIndexedNode(node))
+		{
+			bandIndex.Add(node);
+		}
+
+		AddToPickIndex(node);
+
+		if (node == lastCompleteNode)
+			break;
+	}
+}
+
+void PageRenderer::InvalidateScrollCache(Node* node)
+{
+	if (node->size.y > 0)
+	{
+		scrollCache.Invalidate(node->anchor.y, (long) node->anchor.y + node->size.y);
+	}
+	else
+	{
+		// Containers like links don't have a size of their own
+		scrollCache.Clear();
+	}
+}
+
+void PageRenderer::CheckScrollCacheIsCurrent()
+{
+	// Focus changes how some nodes are drawn, and the cache only covers one horizontal position
+	if (scrollCache.focusedNode != app.ui.GetFocusedNode() || scrollCache.scrollPositionX != app.ui.GetScrollPositionX())
+	{
+		scrollCache.Clear();
+		scrollCache.focusedNode = app.ui.GetFocusedNode();
+		scrollCache.scrollPositionX = app.ui.GetScrollPositionX();
+	}
+}
+
+// Called when there is nothing else to draw. Draws one band that isn't cached yet, starting
+// with the ones just below the window since reading down the page is the common case
+void PageRenderer::FillScrollCache()
+{
+	if (!scrollCache.IsEnabled() || !scrollCache.GetNumBands() || visiblePageHeight <= 0 || !app.page.layout.IsFinished()
+		|| app.pageLoadTask.IsBusy() || app.pageContentLoadTask.IsBusy() || Platform::input->HasInputPending())
+	{
+		return;
+	}
+
+	CheckScrollCacheIsCurrent();
+
+	Rect& windowRect = app.ui.windowRect;
+	int bandHeight = scrollCache.GetBandHeight();
+	long windowTop = app.ui.GetScrollPositionY();
+	long windowBottom = windowTop + windowRect.height;
+
+	int lastPageBand = (int)((visiblePageHeight - 1) / bandHeight);
+	int numBelow = (scrollCache.GetNumBands() * 2 + 2) / 3;
+	int numAbove = scrollCache.GetNumBands() - numBelow;
+	int firstBelow = (int)(windowBottom / bandHeight);
+	int firstAbove = windowTop > 0 ? (int)((windowTop - 1) / bandHeight) : -1;
+
+	scrollCache.SetWantedBands(firstAbove - numAbove + 1, firstAbove, firstBelow, firstBelow + numBelow - 1);
+
+	for (int n = 0; n < numBelow + numAbove; n++)
+	{
+		int index = n < numBelow ? firstBelow + n : firstAbove - (n - numBelow);
+		if (index < 0 || index > lastPageBand || scrollCache.Find(index))
+		{
+			continue;
+		}
+
+		DrawScrollCacheBand(index);
+		return;
+	}
+}
+
+// Draws a band of the page into the scratch buffer by pointing the surface lines at the top of
+// the window at it for a moment, then moves it to the band's storage
+void PageRenderer::DrawScrollCacheBand(int index)
+{
+	ScrollCache::Band* band = scrollCache.AllocateBand(index);
+	if (!band)
+	{
+		return;
+	}
+
+	Rect& windowRect = app.ui.windowRect;
+	DrawSurface* surface = Platform::video->drawSurface;
+	int bandHeight = scrollCache.GetBandHeight();
+	int lineBytes = scrollCache.GetLineBytes();
+	int lineOffset = scrollCache.GetLineOffset();
+	uint8_t* scratch = scrollCache.GetScratchBuffer();
+	int top = windowRect.y;
+	int bottom = top + bandHeight;
+
+	// An on screen region may still be waiting to be queued again, so keep it apart from the band's
+	int screenMissedUpperClip = missedUpperClip;
+	int screenMissedLowerClip = missedLowerClip;
+	missedUpperClip = missedLowerClip = 0;
+
+	FindOverlappingNodesInRegion(top, bottom, (int)(top - (long) index * bandHeight));
+
+	bool isBandComplete = missedLowerClip <= missedUpperClip;
+	missedUpperClip = screenMissedUpperClip;
+	missedLowerClip = screenMissedLowerClip;
+
+	if (!isBandComplete)
+	{
+		// Couldn't queue everything in the band so it would be incomplete
+		renderQueue.Clear();
+		band->index = -1;
+		return;
+	}
+
+	uint8_t* savedLines[SCROLL_CACHE_MAX_BAND_HEIGHT];
+
+	Platform::input->HideMouse();
+
+	for (int n = 0; n < bandHeight; n++)
+	{
+		savedLines[n] = surface->lines[top + n];
+		// Offset so that the left edge of the window lands at the start of the scratch line
+		surface->lines[top + n] = scratch + n * lineBytes - lineOffset;
+	}
+
+	DrawContext context;
+	InitContext(context);
+	context.clipTop = top;
+	context.clipBottom = bottom;
+	context.drawOffsetX = 0;
+	context.drawOffsetY = 0;
+	surface->FillRect(context, windowRect.x, top, windowRect.width, bandHeight, app.page.colourScheme.pageColour);
+
+	context.drawOffsetX = -app.ui.GetScrollPositionX();
+	context.drawOffsetY = (int)(top - (long) index * bandHeight);
+
+	while (renderQueue.Front())
+	{
+		RenderQueue::Item* item = renderQueue.Front();
+		Node* node = item->node.Get();
+
+		context.clipTop = item->upperClip;
+		context.clipBottom = item->lowerClip;
+		node->Handler().Draw(context, node);
+
+		renderQueue.RemoveFront();
+	}
+
+	for (int n = 0; n < bandHeight; n++)
+	{
+		surface->lines[top + n] = savedLines[n];
+	}
+
+	Platform::input->ShowMouse();
+
+	void* data = band->data.GetPtr();
+	if (!data)
+	{
+		band->index = -1;
+		return;
+	}
+	memcpy(data, scratch, bandHeight * lineBytes);
+	band->data.Commit();
+}
+
+void PageRenderer::InvertNode(Node* node)
+{
+	InvalidateScrollCache(node);
+
+	Platform::input->HideMouse();
+	Rect& windowRect = app.ui.windowRect;
+	DrawContext invertContext;
+
+	InitContext(invertContext);
+	invertContext.clipBottom = windowRect.y + windowRect.height;
+
+	//if (invertContext.clipTop < upperContext.clipBottom)
+	//{
+	//	invertContext.clipTop = upperContext.clipBottom;
+	//}
+	//if (invertContext.clipBottom > lowerContext.clipTop)
 	//{
 	//	invertContext.clipBottom = lowerContext.clipTop;
 	//}
@@ -614,3 +1010,816 @@ void PageRenderer::InvertNode(Node* node)
 	Platform::input->ShowMouse();
 }
 
+void RenderBandIndex::Reset()
+{
+	for (int n = 0; n < MAX_RENDER_BAND_GROUPS; n++)
+	{
+		groups[n] = nullptr;
+	}
+	isValid = true;
+}
+
+void RenderBandIndex::Clear()
+{
+	for (int n = 0; n < MAX_RENDER_BAND_GROUPS; n++)
+	{
+		if (groups[n])
+		{
+			for (int i = 0; i < RENDER_BANDS_PER_GROUP; i++)
+			{
+				RenderBand& band = groups[n][i];
+				band.last = band.first;
+				band.lastCount = 0;
+			}
+		}
+	}
+	isValid = true;
+}
+
+int RenderBandIndex::GetBandIndex(long y)
+{
+	if (y < 0)
+		return 0;
+
+	long index = y / RENDER_BAND_HEIGHT;
+	return index < MAX_RENDER_BANDS ? (int) index : MAX_RENDER_BANDS - 1;
+}
+
+RenderBand* RenderBandIndex::GetBand(int index)
+{
+	RenderBand* group = groups[index / RENDER_BANDS_PER_GROUP];
+	return group ? &group[index % RENDER_BANDS_PER_GROUP] : nullptr;
+}
+
+bool RenderBandIndex::Add(Node* node)
+{
+	return Add(node, node->anchor.y, (long) node->anchor.y + node->size.y);
+}
+
+bool RenderBandIndex::Add(Node* node, long top, long bottom)
+{
+	int firstBand = GetBandIndex(top);
+	int lastBand = GetBandIndex(bottom - 1);
+
+	for (int index = firstBand; index <= lastBand; index++)
+	{
+		if (!AddToBand(index, node))
+		{
+			isValid = false;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool RenderBandIndex::AddToBand(int index, Node* node)
+{
+	RenderBand*& group = groups[index / RENDER_BANDS_PER_GROUP];
+	if (!group)
+	{
+		group = (RenderBand*) MemoryManager::pageAllocator.Allocate(sizeof(RenderBand) * RENDER_BANDS_PER_GROUP);
+		if (!group)
+		{
+			return false;
+		}
+		memset(group, 0, sizeof(RenderBand) * RENDER_BANDS_PER_GROUP);
+	}
+
+	RenderBand& band = group[index % RENDER_BANDS_PER_GROUP];
+
+	if (!band.last || band.lastCount == RENDER_BAND_BLOCK_SIZE)
+	{
+		RenderBandBlock* block = band.last ? band.last->next : nullptr;
+
+		if (!block)
+		{
+			block = MemoryManager::pageAllocator.Alloc<RenderBandBlock>();
+			if (!block)
+			{
+				return false;
+			}
+			block->next = nullptr;
+
+			if (band.last)
+			{
+				band.last->next = block;
+			}
+			else
+			{
+				band.first = block;
+			}
+		}
+
+		band.last = block;
+		band.lastCount = 0;
+	}
+
+	band.last->nodes[band.lastCount++] = node;
+	return true;
+}
+
+void RenderQueue::Reset()
+{
+	// Storage belongs to the page allocator, which is reset along with the page
+	head = tail = lastPriority = freeItems = nullptr;
+	memset(buckets, 0, sizeof(buckets));
+	size = 0;
+}
+
+void RenderQueue::Clear()
+{
+	if (tail)
+	{
+		tail->next = freeItems;
+		freeItems = head;
+	}
+	head = tail = lastPriority = nullptr;
+	memset(buckets, 0, sizeof(buckets));
+	size = 0;
+}
+
+int RenderQueue::GetBucketIndex(Node* node)
+{
+#ifdef _DOS
+	return (FP_SEG(node) ^ FP_OFF(node)) & (RENDER_QUEUE_HASH_SIZE - 1);
+#else
+	return (int)(((uintptr_t) node) >> 4) & (RENDER_QUEUE_HASH_SIZE - 1);
+#endif
+}
+
+RenderQueue::Item* RenderQueue::AllocateItem()
+{
+	if (!freeItems)
+	{
+		Item* items = (Item*) MemoryManager::pageAllocator.Allocate(sizeof(Item) * RENDER_QUEUE_ITEMS_PER_ALLOCATION);
+		if (!items)
+		{
+			return nullptr;
+		}
+
+		for (int n = 0; n < RENDER_QUEUE_ITEMS_PER_ALLOCATION; n++)
+		{
+			items[n].next = freeItems;
+			freeItems = &items[n];
+		}
+	}
+
+	Item* item = freeItems;
+	freeItems = item->next;
+	return item;
+}
+
+void RenderQueue::FreeItem(Item* item)
+{
+	item->next = freeItems;
+	freeItems = item;
+}
+
+bool RenderQueue::Add(Node* node, int upperClip, int lowerClip, bool isPriority)
+{
+	int bucketIndex = GetBucketIndex(node);
+
+	for (Item* item = buckets[bucketIndex]; item; item = item->nextInBucket)
+	{
+		if (item->node == node && upperClip <= item->lowerClip && lowerClip >= item->upperClip)
+		{
+			// Spans overlap or touch so grow the existing clip region
+			if (upperClip < item->upperClip)
+			{
+				item->upperClip = upperClip;
+			}
+			if (lowerClip > item->lowerClip)
+			{
+				item->lowerClip = lowerClip;
+			}
+			return true;
+		}
+	}
+
+	Item* newItem = AllocateItem();
+	if (!newItem)
+	{
+		return false;
+	}
+
+	newItem->node = node;
+	newItem->upperClip = upperClip;
+	newItem->lowerClip = lowerClip;
+	newItem->nextInBucket = buckets[bucketIndex];
+	buckets[bucketIndex] = newItem;
+	size++;
+
+	// A parent of a queued priority item must be drawn before it, so it is drawn early too.
+	// Only the priority items need checking and there are few of them
+	if (!isPriority && lastPriority && node->firstChild)
+	{
+		for (Item* item = head; ; item = item->next)
+		{
+			if (item->node->IsChildOf(node))
+			{
+				isPriority = true;
+				break;
+			}
+			if (item == lastPriority)
+			{
+				break;
+			}
+		}
+	}
+
+	if (isPriority)
+	{
+		// Goes after the other priority items, but must still follow any queued ancestor
+		Item* prev = MoveQueuedAncestorsToPriority(node);
+		InsertAfter(prev, newItem);
+		newItem->isPriority = true;
+		lastPriority = newItem;
+	}
+	else
+	{
+		InsertAfter(tail, newItem);
+		newItem->isPriority = false;
+	}
+
+	// Parents must be drawn before their children
+	if (node->firstChild)
+	{
+		MoveQueuedDescendantsAfter(node, newItem);
+	}
+
+	return true;
+}
+
+// Ancestors of a priority item that are queued behind the priority items are brought forward
+// to join them, outermost first. Returns the item that the new priority item should follow
+RenderQueue::Item* RenderQueue::MoveQueuedAncestorsToPriority(Node* node)
+{
+	Item* insertPoint = lastPriority;
+	Item* nearest = nullptr;
+
+	for (Node* parent = node->parent.Get(); parent; parent = parent->parent.Get())
+	{
+		for (Item* item = buckets[GetBucketIndex(parent)]; item; item = item->nextInBucket)
+		{
+			if (item->node == parent && !item->isPriority)
+			{
+				// Each one goes in front of the nearer ones already moved
+				MoveAfter(insertPoint, item);
+				item->isPriority = true;
+				if (!nearest)
+				{
+					nearest = item;
+				}
+			}
+		}
+	}
+
+	if (nearest)
+	{
+		lastPriority = nearest;
+	}
+	return lastPriority;
+}
+
+// Moves any queued descendants of a node to just after its item, in tree order so that they
+// stay parent first. The subtree is walked and each node looked up in the hash, but if the
+// subtree turns out to be bigger than the queue, the rest are found by searching the queue
+void RenderQueue::MoveQueuedDescendantsAfter(Node* node, Item* item)
+{
+	Item* last = item;
+	int searchesLeft = size;
+	Node* child = node->firstChild.Get();
+
+	while (child && searchesLeft > 0)
+	{
+		for (Item* queued = buckets[GetBucketIndex(child)]; queued; queued = queued->nextInBucket)
+		{
+			if (queued->node == child)
+			{
+				last = MoveAfter(last, queued);
+				queued->isPriority = item->isPriority;
+			}
+		}
+		searchesLeft--;
+
+		if (child->firstChild)
+		{
+			child = child->firstChild.Get();
+		}
+		else
+		{
+			while (child != node && !child->next)
+			{
+				child = child->parent.Get();
+			}
+			child = child == node ? nullptr : child->next.Get();
+		}
+	}
+
+	if (child)
+	{
+		// Only the ones still queued ahead of the node's item can be out of order
+		Item* queued = head;
+		while (queued != item)
+		{
+			Item* next = queued->next;
+			if (queued->node->IsChildOf(node))
+			{
+				last = MoveAfter(last, queued);
+				queued->isPriority = item->isPriority;
+			}
+			queued = next;
+		}
+	}
+
+	if (item->isPriority)
+	{
+		lastPriority = last;
+	}
+}
+
+void RenderQueue::InsertAfter(Item* prev, Item* item)
+{
+	item->prev = prev;
+
+	if (prev)
+	{
+		item->next = prev->next;
+		prev->next = item;
+	}
+	else
+	{
+		item->next = head;
+		head = item;
+	}
+
+	if (item->next)
+	{
+		item->next->prev = item;
+	}
+	else
+	{
+		tail = item;
+	}
+}
+
+void RenderQueue::Unlink(Item* item)
+{
+	if (item->prev)
+	{
+		item->prev->next = item->next;
+	}
+	else
+	{
+		head = item->next;
+	}
+
+	if (item->next)
+	{
+		item->next->prev = item->prev;
+	}
+	else
+	{
+		tail = item->prev;
+	}
+
+	if (lastPriority == item)
+	{
+		lastPriority = item->prev;
+	}
+}
+
+// Returns the moved item so that a run of moves can keep their order
+RenderQueue::Item* RenderQueue::MoveAfter(Item* prev, Item* item)
+{
+	if (prev != item)
+	{
+		Unlink(item);
+		InsertAfter(prev, item);
+	}
+	return item;
+}
+
+void RenderQueue::MoveFrontToBack()
+{
+	Item* item = head;
+	if (item && item != tail)
+	{
+		MoveAfter(tail, item);
+		item->isPriority = false;
+	}
+}
+
+void RenderQueue::RemoveFromBucket(Item* item)
+{
+	Item** link = &buckets[GetBucketIndex(item->node.Get())];
+	while (*link != item)
+	{
+		link = &(*link)->nextInBucket;
+	}
+	*link = item->nextInBucket;
+}
+
+void RenderQueue::RemoveFront()
+{
+	Item* item = head;
+	if (item)
+	{
+		Unlink(item);
+		RemoveFromBucket(item);
+		FreeItem(item);
+		size--;
+	}
+}
+
+void RenderQueue::Scroll(int scrollDelta, int minY, int maxY)
+{
+	Item* item = head;
+
+	while (item)
+	{
+		Item* next = item->next;
+
+		item->upperClip -= scrollDelta;
+		item->lowerClip -= scrollDelta;
+
+		if (item->upperClip < minY)
+			item->upperClip = minY;
+		if (item->lowerClip > maxY)
+			item->lowerClip = maxY;
+
+		if (item->lowerClip <= item->upperClip)
+		{
+			// Scrolled off screen, can remove from queue
+			Unlink(item);
+			RemoveFromBucket(item);
+			FreeItem(item);
+			size--;
+		}
+
+		item = next;
+	}
+}
+
+bool RenderQueue::Contains(Node* node)
+{
+	for (Item* item = buckets[GetBucketIndex(node)]; item; item = item->nextInBucket)
+	{
+		if (item->node == node)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+bool DamageTracker::CanMerge(Region& a, Region& b)
+{
+	// Same columns and touching vertically
+	if (a.left == b.left && a.right == b.right && a.top <= b.bottom && a.bottom >= b.top)
+	{
+		return true;
+	}
+	// Same rows and touching horizontally
+	if (a.top == b.top && a.bottom == b.bottom && a.left <= b.right && a.right >= b.left)
+	{
+		return true;
+	}
+	// One contains the other
+	if (a.left <= b.left && a.right >= b.right && a.top <= b.top && a.bottom >= b.bottom)
+	{
+		return true;
+	}
+	if (b.left <= a.left && b.right >= a.right && b.top <= a.top && b.bottom >= a.bottom)
+	{
+		return true;
+	}
+	return false;
+}
+
+bool DamageTracker::Add(int left, int top, int right, int bottom)
+{
+	if (right <= left || bottom <= top)
+	{
+		return true;
+	}
+
+	Region newRegion;
+	newRegion.left = left;
+	newRegion.top = top;
+	newRegion.right = right;
+	newRegion.bottom = bottom;
+
+	// Merging can make the new region mergeable with one that was already checked, so start over
+	for (int n = 0; n < count; n++)
+	{
+		Region& region = regions[n];
+		if (CanMerge(newRegion, region))
+		{
+			if (region.left < newRegion.left)
+				newRegion.left = region.left;
+			if (region.top < newRegion.top)
+				newRegion.top = region.top;
+			if (region.right > newRegion.right)
+				newRegion.right = region.right;
+			if (region.bottom > newRegion.bottom)
+				newRegion.bottom = region.bottom;
+
+			regions[n] = regions[--count];
+			n = -1;
+		}
+	}
+
+	if (count == MAX_DAMAGE_REGIONS)
+	{
+		return false;
+	}
+
+	regions[count++] = newRegion;
+	return true;
+}
+
+void DamageTracker::Scroll(int scrollDelta, int minY, int maxY)
+{
+	for (int n = 0; n < count; n++)
+	{
+		Region& region = regions[n];
+		region.top -= scrollDelta;
+		region.bottom -= scrollDelta;
+
+		if (region.top < minY)
+			region.top = minY;
+		if (region.bottom > maxY)
+			region.bottom = maxY;
+
+		if (region.bottom <= region.top)
+		{
+			// Scrolled off screen
+			regions[n--] = regions[--count];
+		}
+	}
+}
+
+ScrollCache::ScrollCache()
+	: focusedNode(nullptr)
+	, scrollPositionX(0)
+	, bandHeight(0)
+	, lineBytes(0)
+	, lineOffset(0)
+	, scratch(nullptr)
+	, numBands(0)
+	, numAllocated(0)
+	, numConventional(0)
+	, firstAbove(-1)
+	, lastAbove(-1)
+	, firstBelow(-1)
+	, lastBelow(-1)
+{
+}
+
+void ScrollCache::Init(DrawSurface* surface, const Rect& windowRect)
+{
+	int bitsPerPixel;
+
+	switch (surface->format)
+	{
+	case DrawSurface::Format_1BPP:
+		bitsPerPixel = 1;
+		break;
+	case DrawSurface::Format_2BPP:
+		bitsPerPixel = 2;
+		break;
+	case DrawSurface::Format_8BPP:
+		bitsPerPixel = 8;
+		break;
+	default:
+		// Planar and banked surfaces can't be redirected a line at a time
+		return;
+	}
+
+	// Bands are copied a byte at a time, so both edges of the window must fall on a byte
+	// boundary or the copy would overwrite pixels either side of it
+	long leftBit = (long) windowRect.x * bitsPerPixel;
+	long rightBit = (long) (windowRect.x + windowRect.width) * bitsPerPixel;
+	if ((leftBit & 7) || (rightBit & 7) || rightBit <= leftBit)
+	{
+		return;
+	}
+
+	lineOffset = (int)(leftBit >> 3);
+	lineBytes = (int)((rightBit - leftBit) >> 3);
+
+	int height = SCROLL_CACHE_BLOCK_SIZE / lineBytes;
+	if (height > SCROLL_CACHE_MAX_BAND_HEIGHT)
+		height = SCROLL_CACHE_MAX_BAND_HEIGHT;
+	if (height > windowRect.height)
+		height = windowRect.height;
+	if (height < SCROLL_CACHE_MIN_BAND_HEIGHT)
+	{
+		return;
+	}
+
+	scratch = (uint8_t*) malloc(height * lineBytes);
+	if (!scratch)
+	{
+		return;
+	}
+
+	bandHeight = height;
+}
+
+void ScrollCache::Reset()
+{
+	// Band storage comes from the page block allocator, which is reset with the page
+	long maxBands = SCROLL_CACHE_SIZE / ((long) bandHeight * lineBytes + 1);
+	numBands = maxBands < SCROLL_CACHE_MAX_BANDS ? (int) maxBands : SCROLL_CACHE_MAX_BANDS;
+	numAllocated = 0;
+	numConventional = 0;
+	firstAbove = lastAbove = firstBelow = lastBelow = -1;
+	focusedNode = nullptr;
+	scrollPositionX = 0;
+	Clear();
+}
+
+void ScrollCache::Clear()
+{
+	for (int n = 0; n < SCROLL_CACHE_MAX_BANDS; n++)
+	{
+		bands[n].index = -1;
+	}
+}
+
+void ScrollCache::Invalidate(long top, long bottom)
+{
+	if (!bandHeight)
+	{
+		return;
+	}
+
+	int firstIndex = (int)(top / bandHeight);
+	int lastIndex = (int)((bottom - 1) / bandHeight);
+
+	for (int n = 0; n < numAllocated; n++)
+	{
+		if (bands[n].index >= firstIndex && bands[n].index <= lastIndex)
+		{
+			bands[n].index = -1;
+		}
+	}
+}
+
+ScrollCache::Band* ScrollCache::Find(int index)
+{
+	for (int n = 0; n < numAllocated; n++)
+	{
+		if (bands[n].index == index)
+		{
+			return &bands[n];
+		}
+	}
+	return nullptr;
+}
+
+void ScrollCache::SetWantedBands(int inFirstAbove, int inLastAbove, int inFirstBelow, int inLastBelow)
+{
+	firstAbove = inFirstAbove;
+	lastAbove = inLastAbove;
+	firstBelow = inFirstBelow;
+	lastBelow = inLastBelow;
+}
+
+bool ScrollCache::IsWanted(int index)
+{
+	return (index >= firstAbove && index <= lastAbove) || (index >= firstBelow && index <= lastBelow);
+}
+
+// Finds a slot for a band, preferring an empty one, then new storage, then the band
+// furthest from the window that isn't wanted any more
+ScrollCache::Band* ScrollCache::AllocateBand(int index)
+{
+	Band* result = nullptr;
+	int furthest = -1;
+	int centre = (lastAbove + firstBelow) / 2;
+
+	for (int n = 0; n < numAllocated; n++)
+	{
+		Band& band = bands[n];
+		if (band.index == -1)
+		{
+			result = &band;
+			break;
+		}
+
+		if (!IsWanted(band.index))
+		{
+			int distance = band.index < centre ? centre - band.index : band.index - centre;
+			if (distance > furthest)
+			{
+				furthest = distance;
+				result = &band;
+			}
+		}
+	}
+
+	if ((!result || result->index != -1) && numAllocated < numBands)
+	{
+		// Blocks stay allocated until the page is reset, so only ask for memory that will be used.
+		// A band isn't worth caching in the swap file, which is used once conventional memory is low
+		MemBlockHandle data;
+		uint16_t size = (uint16_t)(bandHeight * lineBytes);
+
+		if (numConventional < SCROLL_CACHE_MAX_CONVENTIONAL_BANDS && !MemoryManager::pageBlockAllocator.IsConventionalMemoryLow())
+		{
+			data = MemoryManager::pageBlockAllocator.Allocate(size);
+			if (data.type == MemBlockHandle::Conventional)
+			{
+				numConventional++;
+			}
+		}
+		else
+		{
+			data = MemoryManager::pageBlockAllocator.AllocateExpanded(size);
+		}
+
+		if (!data.IsAllocated())
+		{
+			// Out of memory, so stop asking
+			numBands = numAllocated;
+		}
+		else
+		{
+			result = &bands[numAllocated++];
+			result->data = data;
+		}
+	}
+
+	if (result)
+	{
+		result->index = index;
+	}
+	return result;
+}
+
+ImageSliceBudget::ImageSliceBudget()
+	: targetTicks(IMAGE_SLICE_TARGET_TIME)
+	, minLines(IMAGE_SLICE_MIN_LINES)
+	, maxLines(IMAGE_SLICE_MAX_LINES)
+	, defaultLines(IMAGE_SLICE_DEFAULT_LINES)
+	, format(DrawSurface::Format_1BPP)
+	, pixelsPerPeriod(0)
+	, samplePixels(0)
+	, sampleTicks(0)
+{
+}
+
+int ImageSliceBudget::GetSliceLines(DrawSurface::Format surfaceFormat, int imageWidth, clock_t timeLeft)
+{
+	if (!pixelsPerPeriod || surfaceFormat != format || imageWidth <= 0)
+	{
+		return defaultLines;
+	}
+
+	clock_t ticks = timeLeft < targetTicks ? timeLeft : targetTicks;
+	long periods = ticks / IMAGE_SLICE_RATE_PERIOD;
+	if (periods < 1)
+	{
+		periods = 1;
+	}
+
+	long lines = pixelsPerPeriod * periods / imageWidth;
+	if (lines < minLines)
+		return minLines;
+	if (lines > maxLines)
+		return maxLines;
+	return (int) lines;
+}
+
+void ImageSliceBudget::AddSample(DrawSurface::Format surfaceFormat, long pixels, clock_t ticks)
+{
+	if (surfaceFormat != format)
+	{
+		// Measurements for a different surface don't apply
+		format = surfaceFormat;
+		pixelsPerPeriod = 0;
+		samplePixels = 0;
+		sampleTicks = 0;
+	}
+
+	samplePixels += pixels;
+	sampleTicks += ticks;
+
+	if (sampleTicks >= IMAGE_SLICE_SAMPLE_TIME)
+	{
+		long measured = samplePixels / (sampleTicks / IMAGE_SLICE_RATE_PERIOD);
+		if (measured < 1)
+		{
+			measured = 1;
+		}
+
+		// Smooth out the measurement so one slow slice doesn't swing the slice size too far
+		pixelsPerPeriod = pixelsPerPeriod ? (pixelsPerPeriod * 3 + measured) / 4 : measured;
+		samplePixels = 0;
+		sampleTicks = 0;
+	}
+}
@@ -1,22 +1,36 @@
 #ifndef _RENDER_H_
 #define _RENDER_H_
 
+#include <time.h>
 #include "Draw/Surface.h"
 #include "Node.h"
+#include "Memory/MemBlock.h"
 
 class App;
 class Node;
 struct DrawContext;
 struct Rect;
 
-#define MAX_RENDER_QUEUE_SIZE 512
+#define RENDER_QUEUE_HASH_SIZE 64			// Must be a power of two
+#define RENDER_QUEUE_ITEMS_PER_ALLOCATION 32
 
-struct RenderQueue
+// Nodes waiting to be drawn along with the part of the screen they need drawing in. Items are
+// kept in drawing order and also hashed by node, so finding whether a node is already queued
+// doesn't scan the whole queue. Storage comes from the page allocator and is recycled through
+// a free list, so the queue only grows to its high water mark. Priority items (the focused node)
+// are drawn before everything else, and partially drawn images go to the back of the queue.
+// Queued ancestors and descendants of a new item are found through the hash as well
+class RenderQueue
 {
+public:
 	struct Item
 	{
-		Node* node;
+		NodePtr node;
 		int upperClip, lowerClip;
+		Item* prev;
+		Item* next;
+		Item* nextInBucket;
+		bool isPriority;
 	};
 
 	RenderQueue()
@@ -24,30 +38,200 @@ struct RenderQueue
 		Reset();
 	}
 
-	void Reset()
+	void Reset();
+	void Clear();
+	bool Add(Node* node, int upperClip, int lowerClip, bool isPriority = false);
+	void RemoveFront();
+	void MoveFrontToBack();
+	void Scroll(int scrollDelta, int minY, int maxY);
+	bool Contains(Node* node);
+
+	Item* Front() { return head; }
+	int Size() { return size; }
+
+private:
+	static int GetBucketIndex(Node* node);
+	Item* AllocateItem();
+	void RemoveFromBucket(Item* item);
+	void FreeItem(Item* item);
+	void InsertAfter(Item* prev, Item* item);
+	void Unlink(Item* item);
+	Item* MoveAfter(Item* prev, Item* item);
+	Item* MoveQueuedAncestorsToPriority(Node* node);
+	void MoveQueuedDescendantsAfter(Node* node, Item* item);
+
+	Item* head;
+	Item* tail;
+	Item* lastPriority;			// Last of the priority items at the front of the queue
+	Item* freeItems;
+	Item* buckets[RENDER_QUEUE_HASH_SIZE];
+	int size;
+};
+
+#define MAX_DAMAGE_REGIONS 8
+
+// Screen regions that need clearing to the page colour before the queued nodes are drawn over
+// them. Regions are only merged when the result covers exactly the same area, so a merge never
+// clears anything that isn't going to be redrawn
+class DamageTracker
+{
+public:
+	struct Region
 	{
-		head = tail = 0;
-	}
-	int Size()
+		int left, top, right, bottom;
+	};
+
+	DamageTracker()
 	{
-		return tail - head;
+		Clear();
 	}
-	RenderQueue::Item* Dequeue()
+
+	void Clear() { count = 0; }
+	bool Add(int left, int top, int right, int bottom);
+	void Scroll(int scrollDelta, int minY, int maxY);
+
+	int Count() { return count; }
+	Region& Get(int index) { return regions[index]; }
+
+private:
+	static bool CanMerge(Region& a, Region& b);
+
+	Region regions[MAX_DAMAGE_REGIONS];
+	int count;
+};
+
+#define IMAGE_SLICE_TARGET_TIME (CLOCKS_PER_SEC / 20)	// Keeps input responsive between slices
+#define IMAGE_SLICE_SAMPLE_TIME (CLOCKS_PER_SEC / 2)		// clock() is coarse so timings are gathered over several slices
+#define IMAGE_SLICE_RATE_PERIOD (CLOCKS_PER_SEC >= 100 ? CLOCKS_PER_SEC / 100 : 1)	// Throughput is kept as pixels per 10ms
+#define IMAGE_SLICE_MIN_LINES 2
+#define IMAGE_SLICE_MAX_LINES 256
+#define IMAGE_SLICE_DEFAULT_LINES 16
+
+// Decides how many lines of an image to draw on each turn in the render queue. The number of
+// pixels the surface can blit in a given time is measured as images are drawn, and slices are
+// sized to take targetTicks or whatever is left of the update, whichever is shorter
+class ImageSliceBudget
+{
+public:
+	ImageSliceBudget();
+
+	int GetSliceLines(DrawSurface::Format format, int imageWidth, clock_t timeLeft);
+	void AddSample(DrawSurface::Format format, long pixels, clock_t ticks);
+
+	// Policy, can be tuned per platform
+	clock_t targetTicks;
+	int minLines;
+	int maxLines;
+	int defaultLines;		// Used until the surface has been measured
+
+private:
+	DrawSurface::Format format;
+	long pixelsPerPeriod;	// Zero until measured
+	long samplePixels;
+	clock_t sampleTicks;
+};
+
+#define SCROLL_CACHE_MAX_BANDS 32
+#define SCROLL_CACHE_SIZE (64 * 1024l)					// Total storage to use across all bands
+#define SCROLL_CACHE_BLOCK_SIZE 4000					// Small enough for a single EMS page or XMS copy buffer
+#define SCROLL_CACHE_MIN_BAND_HEIGHT 4
+#define SCROLL_CACHE_MAX_BAND_HEIGHT 64
+#define SCROLL_CACHE_MAX_CONVENTIONAL_BANDS 4			// Don't use up memory the page might need
+
+// Pre-drawn strips of the page just above and below the window, filled in while the browser is
+// idle so that scrolling into them is a copy rather than drawing the nodes again. Only surfaces
+// that are written a line at a time through DrawSurface::lines can be drawn off screen
+class ScrollCache
+{
+public:
+	struct Band
+	{
+		MemBlockHandle data;
+		int index;				// Page band index, -1 if the slot is empty
+	};
+
+	ScrollCache();
+
+	void Init(DrawSurface* surface, const Rect& windowRect);
+	void Reset();
+	void Clear();
+	void Invalidate(long top, long bottom);
+
+	Band* Find(int index);
+	Band* AllocateBand(int index);
+	void SetWantedBands(int firstAbove, int lastAbove, int firstBelow, int lastBelow);
+	bool IsWanted(int index);
+
+	bool IsEnabled() { return bandHeight > 0; }
+	int GetBandHeight() { return bandHeight; }
+	int GetLineBytes() { return lineBytes; }
+	int GetLineOffset() { return lineOffset; }
+	int GetNumBands() { return numBands; }
+	uint8_t* GetScratchBuffer() { return scratch; }
+
+	Node* focusedNode;			// Focus and horizontal scroll position the contents were drawn with
+	int scrollPositionX;
+
+private:
+	int bandHeight;
+	int lineBytes;
+	int lineOffset;				// Bytes from the start of a surface line to the left edge of the window
+	uint8_t* scratch;			// Bands are drawn here first, since drawing can remap EMS
+	int numBands;				// Slots that can be used, shrinks if we run out of storage
+	int numAllocated;
+	int numConventional;
+	int firstAbove, lastAbove;	// Bands that are worth keeping for the current scroll position
+	int firstBelow, lastBelow;
+	Band bands[SCROLL_CACHE_MAX_BANDS];
+};
+
+// The page is split into horizontal bands so that the nodes overlapping a region of the
+// screen can be found without walking the whole tree
+#define RENDER_BAND_HEIGHT 64
+#define MAX_RENDER_BANDS (32768 / RENDER_BAND_HEIGHT)
+#define RENDER_BANDS_PER_GROUP 32
+#define MAX_RENDER_BAND_GROUPS (MAX_RENDER_BANDS / RENDER_BANDS_PER_GROUP)
+#define RENDER_BAND_BLOCK_SIZE 10
+
+struct RenderBandBlock
+{
+	NodePtr nodes[RENDER_BAND_BLOCK_SIZE];
+	RenderBandBlock* next;
+};
+
+// Nodes that overlap a band, in document order
+struct RenderBand
+{
+	RenderBandBlock* first;
+	RenderBandBlock* last;		// Block being filled, any blocks after it are spare from before the last Clear()
+	uint8_t lastCount;
+};
+
+// Bands and blocks come from the page allocator, so they are kept when the index is cleared
+// and reused when it is filled again
+class RenderBandIndex
+{
+public:
+	RenderBandIndex()
 	{
-		if (head < tail)
-		{
-			RenderQueue::Item* result = &items[head++];
-			if (head == tail)
-			{
-				tail = head = 0;
-			}
-			return result;
-		}
-		return nullptr;
+		Reset();
 	}
 
-	int head, tail;
-	Item items[MAX_RENDER_QUEUE_SIZE];
+	void Reset();
+	void Clear();
+	bool Add(Node* node);
+	bool Add(Node* node, long top, long bottom);
+
+	bool IsValid() { return isValid; }
+	RenderBand* GetBand(int index);
+
+	static int GetBandIndex(long y);
+
+private:
+	bool AddToBand(int index, Node* node);
+
+	RenderBand* groups[MAX_RENDER_BAND_GROUPS];
+	bool isValid;				// False if we ran out of memory and some nodes are missing
 };
 
 class PageRenderer
@@ -65,17 +249,20 @@ public:
 	void GenerateDrawContext(DrawContext& context, Node* node);
 
 	void AddToQueue(Node* node, int upperClip, int lowerClip);
+	bool IsPriorityNode(Node* node);
 
 	void OnPageScroll(int scrollDelta);
 
 	void MarkNodeLayoutComplete(Node* node);
 	void MarkPageLayoutComplete();
+	void MarkPageRelaidOut();
 	void MarkNodeDirty(Node* node, int nodeDirtyTop = -1, int nodeDirtyBottom = -1);
 
 	void InvertNode(Node* node);
+	Node* PickNode(int x, int y);
 
 	int GetVisiblePageHeight() { return visiblePageHeight; }
-	bool IsRendering() { return renderQueue.Size() > 0; }
+	bool IsRendering() { return renderQueue.Front() != nullptr || damage.Count() > 0; }
 
 	void MarkScreenRegionDirty(int left, int top, int right, int bottom);
 
@@ -87,15 +274,36 @@ private:
 	void InitContext(DrawContext& context);
 	void ClampContextToRect(DrawContext& context, Rect& rect);
 	void FindOverlappingNodesInScreenRegion(int top, int bottom);
+	void FindOverlappingNodesInRegion(int top, int bottom, int drawOffsetY);
+	void QueueNodeInRegion(Node* node, int top, int bottom, int drawOffsetY);
+	void ShowExposedScreenRegion(int top, int bottom);
+	void FillScrollCache();
+	void DrawScrollCacheBand(int index);
+	void CheckScrollCacheIsCurrent();
+	void InvalidateScrollCache(Node* node);
+	void AddDamage(int left, int top, int right, int bottom);
+	void ClearDamagedRegions();
+	void CompleteNodesUpTo(Node* lastNode, bool isPageComplete);
+	bool AddCompletedNode(Node* node);
+	void AddToPickIndex(Node* node);
 
 	bool DoesOverlapWithContext(Node* node, DrawContext& context);
 	bool IsRenderableNode(Node* node);
+	bool IsIndexedNode(Node* node);
 
 	int GetDrawOffsetY();
 
 	App& app;
 
 	RenderQueue renderQueue;
+	DamageTracker damage;
+	ScrollCache scrollCache;
+	ImageSliceBudget imageSliceBudget;
+	int missedUpperClip, missedLowerClip;	// Screen region that couldn't be queued because we ran out of memory
+	Node* priorityNode;				// Focused node that priorityTop and priorityBottom were found for
+	int priorityTop, priorityBottom;	// Vertical extent of the focused node and its children
+	RenderBandIndex bandIndex;
+	RenderBandIndex pickIndex;		// Outermost pickable nodes, for hit testing the mouse position
 
 	Node* lastCompleteNode;
 
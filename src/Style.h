@@ -135,6 +135,7 @@ public:
 	void MarkInterfaceStylesComplete() { numInterfaceStyles = numItems; }
 
 	void Reset() { numItems = numInterfaceStyles; }
+	int GetNumStyles() { return numItems; }
 
 	static StylePool& Get();
 
@@ -94,25 +94,96 @@ static const HTMLTagHandler* tagHandlers[] =
 	NULL
 };
 
+// Handler indices count open elements in HTMLParser::openTagCount, so there must be a counter for
+// each one. This fails to compile once the table outgrows MAX_TAG_HANDLERS
+typedef char TagHandlerLimitCheck[sizeof(tagHandlers) / sizeof(tagHandlers[0]) - 1 < MAX_TAG_HANDLERS ? 1 : -1];
+
+
+// Tag names are looked up through a case insensitive hash of the whole name. The table below
+// is precomputed from the names in tagHandlers[]: each entry is the index + 1 of the handler
+// whose name hashes to that slot, or zero if none does. The multiplier was picked so that
+// every tag gets its own slot, so a lookup costs at most one string comparison. Unknown tags
+// usually hit an empty slot and cost none. When adding a tag, run its name through
+// HashTagName() and put its index + 1 in that slot, picking a new multiplier on a collision.
+// mwbench checks the table with FindUnhashedTag() before it runs
+#define TAG_HASH_MULTIPLIER 37
+#define TAG_HASH_TABLE_SIZE 256
+
+static const uint8_t tagHashTable[TAG_HASH_TABLE_SIZE] =
+{
+	 0,  0,  0,  0, 45, 35, 26,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 38, 37,  4,  0,
+	 0, 27,  0,  0,  0,  0,  0,  0, 47,  0,  0,  0, 48,  0,  7,  0,
+	 0, 24,  0,  0,  0,  0, 46,  0,  0,  8,  9, 10, 11, 12, 13,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  2,  0,  0,  0,  0,  3,  0,
+	 0,  0,  0,  0,  0, 32,  0,  0,  0,  0,  0, 43,  0, 14,  0,  0,
+	 0, 31, 23,  0,  0,  0,  0, 17,  0, 25,  0,  0,  0,  0,  0,  0,
+	16,  5,  0,  0,  0, 29,  0, 33,  0,  6, 36,  0,  0, 28,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 41,  0,  0,  0,
+	 0, 34,  0,  0,  0,  0, 39,  0,  0,  0,  0,  0, 20,  0,  0,  0,
+	40,  0,  0,  0,  0, 15,  0,  0,  0, 42,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0, 21,  0,  0,  0,  0,  0, 44,
+	 0,  0,  0,  0,  0,  0,  0,  0, 19,  1,  0,  0,  0,  0,  0,  0,
+	49,  0,  0,  0,  0,  0,  0, 30, 18, 50,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 22,
+};
+
+uint8_t HTMLTagHandler::numTagHandlers = 0;
+
+#ifdef MWBENCH
+TagLookupStats tagLookupStats;
+#endif
+
+static uint8_t HashTagName(const char* str)
+{
+	uint8_t hash = 0;
+	while (*str)
+	{
+		hash = (uint8_t)(hash * TAG_HASH_MULTIPLIER + tolower((unsigned char)*str));
+		str++;
+	}
+	return hash;
+}
 
 const HTMLTagHandler* DetermineTag(const char* str)
 {
-	for(int n = 0; ; n++)
+#ifdef MWBENCH
+	tagLookupStats.lookups++;
+#endif
+
+	uint8_t slot = tagHashTable[HashTagName(str)];
+	if (slot)
 	{
-		const HTMLTagHandler* handler = tagHandlers[n];
-		if (!handler)
-		{
-			break;
-		}
+		const HTMLTagHandler* handler = tagHandlers[slot - 1];
+#ifdef MWBENCH
+		tagLookupStats.comparisons++;
+#endif
 		if (!stricmp(str, handler->name))
 		{
 			return handler;
 		}
 	}
-	
-	static const HTMLTagHandler genericTag("generic");
-	return &genericTag;
+
+	// Unknown tags share the generic handler at the start of the table
+	return tagHandlers[0];
+}
+
+#ifdef MWBENCH
+// Returns the name of the first handler that DetermineTag() doesn't find, which happens when a
+// tag is added to or moved in tagHandlers[] without updating tagHashTable, or NULL if all are found
+const char* FindUnhashedTag()
+{
+	for (int n = 0; tagHandlers[n]; n++)
+	{
+		if (DetermineTag(tagHandlers[n]->name) != tagHandlers[n])
+		{
+			return tagHandlers[n]->name;
+		}
+	}
+	return NULL;
 }
+#endif
 
 void HrTagHandler::Open(class HTMLParser& parser, char* attributeStr) const
 {
@@ -175,7 +246,7 @@ void ATagHandler::Open(class HTMLParser& parser, char* attributeStr) const
 
 	while(attributes.Parse())
 	{
-		if (!stricmp(attributes.Key(), "href"))
+		if (attributes.KeyId() == AttributeKey::Href)
 		{
 			url = MemoryManager::pageAllocator.AllocString(attributes.Value());
 		}
@@ -210,18 +281,20 @@ void SectionTagHandler::Open(class HTMLParser& parser, char* attributeStr) const
 		AttributeParser attributes(attributeStr);
 		while (attributes.Parse())
 		{
-			if (!stricmp(attributes.Key(), "link"))
+			switch (attributes.KeyId())
 			{
+			case AttributeKey::Link:
 				parser.page.colourScheme.linkColour = HTMLParser::ParseColourCode(attributes.Value());
-			}
-			if (!stricmp(attributes.Key(), "text"))
-			{
+				break;
+			case AttributeKey::Text:
 				parser.page.colourScheme.textColour = HTMLParser::ParseColourCode(attributes.Value());
-			}
-			if (!stricmp(attributes.Key(), "bgcolor"))
-			{
+				break;
+			case AttributeKey::BgColor:
 				parser.page.colourScheme.pageColour = HTMLParser::ParseColourCode(attributes.Value());
 				App::Get().pageRenderer.RefreshAll();
+				break;
+			default:
+				break;
 			}
 		}
 	}
@@ -273,7 +346,7 @@ void FontTagHandler::Open(class HTMLParser& parser, char* attributeStr) const
 		AttributeParser attributes(attributeStr);
 		while (attributes.Parse())
 		{
-			if (!stricmp(attributes.Key(), "size"))
+			if (attributes.KeyId() == AttributeKey::Size)
 			{
 				int fontSize = atoi(attributes.Value());
 
@@ -302,7 +375,7 @@ void FontTagHandler::Open(class HTMLParser& parser, char* attributeStr) const
 					}
 				}
 			}
-			else if (!stricmp(attributes.Key(), "color"))
+			else if (attributes.KeyId() == AttributeKey::Color)
 			{
 				if (Platform::video->paletteLUT)
 				{
@@ -370,25 +443,26 @@ void InputTagHandler::Open(class HTMLParser& parser, char* attributeStr) const
 	AttributeParser attributes(attributeStr);
 	while (attributes.Parse())
 	{
-		if (!stricmp(attributes.Key(), "type"))
+		switch (attributes.KeyId())
 		{
-			if (!stricmp(attributes.Value(), "submit") || !stricmp(attributes.Value(), "button"))
+		case AttributeKey::Type:
+			if (attributes.ValueIs("submit") || attributes.ValueIs("button"))
 			{
 				type = HTMLInputTag::Submit;
 			}
-			else if (!stricmp(attributes.Value(), "text") || !stricmp(attributes.Value(), "search"))
+			else if (attributes.ValueIs("text") || attributes.ValueIs("search"))
 			{
 				type = HTMLInputTag::Text;
 			}
-			else if (!stricmp(attributes.Value(), "password"))
+			else if (attributes.ValueIs("password"))
 			{
 				type = HTMLInputTag::Password;
 			}
-			else if (!stricmp(attributes.Value(), "checkbox"))
+			else if (attributes.ValueIs("checkbox"))
 			{
 				type = HTMLInputTag::CheckBox;
 			}
-			else if (!stricmp(attributes.Value(), "radio"))
+			else if (attributes.ValueIs("radio"))
 			{
 				type = HTMLInputTag::Radio;
 			}
@@ -396,22 +470,21 @@ void InputTagHandler::Open(class HTMLParser& parser, char* attributeStr) const
 			{
 				type = HTMLInputTag::Unknown;
 			}
-		}
-		if (!stricmp(attributes.Key(), "value"))
-		{
+			break;
+		case AttributeKey::Value:
 			value = MemoryManager::pageAllocator.AllocString(attributes.Value());
-		}
-		if (!stricmp(attributes.Key(), "name"))
-		{
+			break;
+		case AttributeKey::Name:
 			name = MemoryManager::pageAllocator.AllocString(attributes.Value());
-		}
-		if (!stricmp(attributes.Key(), "width"))
-		{
+			break;
+		case AttributeKey::Width:
 			width = ExplicitDimension::Parse(attributes.Value());
-		}
-		if (!stricmp(attributes.Key(), "checked"))
-		{
+			break;
+		case AttributeKey::Checked:
 			checked = true;
+			break;
+		default:
+			break;
 		}
 	}
 
@@ -446,6 +519,8 @@ void InputTagHandler::Open(class HTMLParser& parser, char* attributeStr) const
 		}
 	}
 	break;
+	case HTMLInputTag::Unknown:
+		break;
 	}
 }
 
@@ -462,13 +537,13 @@ void FormTagHandler::Open(class HTMLParser& parser, char* attributeStr) const
 		AttributeParser attributes(attributeStr);
 		while (attributes.Parse())
 		{
-			if (!stricmp(attributes.Key(), "action"))
+			if (attributes.KeyId() == AttributeKey::Action)
 			{
 				formData->action = MemoryManager::pageAllocator.AllocString(attributes.Value());
 			}
-			if (!stricmp(attributes.Key(), "method"))
+			if (attributes.KeyId() == AttributeKey::Method)
 			{
-				if (!stricmp(attributes.Value(), "post"))
+				if (attributes.ValueIs("post"))
 				{
 					formData->method = FormNode::Data::Post;
 				}
@@ -492,29 +567,29 @@ void ImgTagHandler::Open(class HTMLParser& parser, char* attributeStr) const
 
 		while (attributes.Parse())
 		{
-			if (!stricmp(attributes.Key(), "alt"))
+			switch (attributes.KeyId())
 			{
+			case AttributeKey::Alt:
 				imageNode->altText = MemoryManager::pageAllocator.AllocString(attributes.Value());
 				if (imageNode->altText)
 				{
 					HTMLParser::ReplaceAmpersandEscapeSequences(imageNode->altText);
 				}
-			}
-			else if (!stricmp(attributes.Key(), "src"))
-			{
+				break;
+			case AttributeKey::Src:
 				imageNode->source = MemoryManager::pageAllocator.AllocString(attributes.Value());
-			}
-			else if (!stricmp(attributes.Key(), "width"))
-			{
+				break;
+			case AttributeKey::Width:
 				imageNode->explicitWidth = ExplicitDimension::Parse(attributes.Value());
-			}
-			else if (!stricmp(attributes.Key(), "height"))
-			{
+				break;
+			case AttributeKey::Height:
 				imageNode->explicitHeight = ExplicitDimension::Parse(attributes.Value());
-			}
-			else if (!stricmp(attributes.Key(), "ismap"))
-			{
+				break;
+			case AttributeKey::IsMap:
 				imageNode->isMap = true;
+				break;
+			default:
+				break;
 			}
 		}
 
@@ -528,34 +603,16 @@ void MetaTagHandler::Open(class HTMLParser& parser, char* attributeStr) const
 
 	while (attributes.Parse())
 	{
-		if (!stricmp(attributes.Key(), "charset"))
+		if (attributes.KeyId() == AttributeKey::Charset)
 		{
-			if (!stricmp(attributes.Value(), "utf-8"))
-			{
-				parser.SetTextEncoding(TextEncoding::UTF8);
-			}
-			else if (!stricmp(attributes.Value(), "ISO-8859-1") || !stricmp(attributes.Value(), "windows-1252"))
-			{
-				parser.SetTextEncoding(TextEncoding::ISO_8859_1);
-			}
-			else if (!stricmp(attributes.Value(), "ISO-8859-2") || !stricmp(attributes.Value(), "windows-1250"))
-			{
-				parser.SetTextEncoding(TextEncoding::ISO_8859_2);
-			}
+			parser.SetTextEncoding(attributes.Value());
 		}
-		else if (!stricmp(attributes.Key(), "content"))
+		else if (attributes.KeyId() == AttributeKey::Content)
 		{
-			if (strstr(attributes.Value(), "charset=utf-8"))
-			{
-				parser.SetTextEncoding(TextEncoding::UTF8);
-			}
-			else if (strstr(attributes.Value(), "charset=ISO-8859-1") || strstr(attributes.Value(), "charset=windows-1252"))
-			{
-				parser.SetTextEncoding(TextEncoding::ISO_8859_1);
-			}
-			else if (strstr(attributes.Value(), "charset=ISO-8859-2") || strstr(attributes.Value(), "charset=windows-1250"))
+			const char* charset = strstr(attributes.Value(), "charset=");
+			if (charset)
 			{
-				parser.SetTextEncoding(TextEncoding::ISO_8859_2);
+				parser.SetTextEncoding(charset + 8);
 			}
 		}
 	}
@@ -591,25 +648,25 @@ void TableTagHandler::Open(class HTMLParser& parser, char* attributeStr) const
 
 		while (attributes.Parse())
 		{
-			if (!stricmp(attributes.Key(), "border"))
+			switch (attributes.KeyId())
 			{
+			case AttributeKey::Border:
 				tableNode->border = attributes.ValueAsInt();
-			}
-			else if (!stricmp(attributes.Key(), "cellpadding"))
-			{
+				break;
+			case AttributeKey::CellPadding:
 				tableNode->cellPadding = attributes.ValueAsInt();
-			}
-			else if (!stricmp(attributes.Key(), "cellSpacing"))
-			{
+				break;
+			case AttributeKey::CellSpacing:
 				tableNode->cellSpacing = attributes.ValueAsInt();
-			}
-			else if (!stricmp(attributes.Key(), "bgcolor"))
-			{
+				break;
+			case AttributeKey::BgColor:
 				tableNode->bgColour = HTMLParser::ParseColourCode(attributes.Value());
-			}
-			else if (!stricmp(attributes.Key(), "width"))
-			{
+				break;
+			case AttributeKey::Width:
 				tableNode->explicitWidth = ExplicitDimension::Parse(attributes.Value());
+				break;
+			default:
+				break;
 			}
 		}
 
@@ -641,21 +698,23 @@ void TableCellTagHandler::Open(class HTMLParser& parser, char* attributeStr) con
 
 		while (attributes.Parse())
 		{
-			if (!stricmp(attributes.Key(), "bgcolor"))
+			switch (attributes.KeyId())
 			{
+			case AttributeKey::BgColor:
 				cellNode->bgColour = HTMLParser::ParseColourCode(attributes.Value());
-			}
-			else if (!stricmp(attributes.Key(), "colspan"))
-			{
+				break;
+			case AttributeKey::ColSpan:
 				cellNode->columnSpan = attributes.ValueAsInt();
 				if (cellNode->columnSpan <= 0)
 				{
 					cellNode->columnSpan = 1;
 				}
-			}
-			else if (!stricmp(attributes.Key(), "width"))
-			{
+				break;
+			case AttributeKey::Width:
 				cellNode->explicitWidth = ExplicitDimension::Parse(attributes.Value());
+				break;
+			default:
+				break;
 			}
 		}
 		parser.PushContext(cellNode, this);
@@ -669,18 +728,22 @@ void TableCellTagHandler::Close(class HTMLParser& parser) const
 
 void SelectTagHandler::Open(class HTMLParser& parser, char* attributeStr) const
 {
-	const char* name = nullptr;
-	AttributeParser attributes(attributeStr);
+	SelectNode::Data* selectNode = SelectNode::Construct(MemoryManager::pageAllocator, "");
 
-	while (attributes.Parse())
+	if (selectNode)
 	{
-		if (!stricmp(attributes.Key(), "name"))
+		AttributeParser attributes(attributeStr);
+
+		while (attributes.Parse())
 		{
-			name = attributes.Value();
+			if (attributes.KeyId() == AttributeKey::Name)
+			{
+				selectNode->name = MemoryManager::pageAllocator.AllocString(attributes.Value());
+			}
 		}
 	}
 
-	parser.PushContext(SelectNode::Construct(MemoryManager::pageAllocator, name), this);
+	parser.PushContext(selectNode, this);
 }
 
 void SelectTagHandler::Close(class HTMLParser& parser) const
@@ -700,7 +763,7 @@ void OptionTagHandler::Open(class HTMLParser& parser, char* attributeStr) const
 
 		while (attributes.Parse())
 		{
-			if (!stricmp(attributes.Key(), "selected"))
+			if (attributes.KeyId() == AttributeKey::Selected)
 			{
 				SelectNode::Data* selectData = optionNode->FindParentDataOfType<SelectNode::Data>(Node::Select);
 				if (selectData)
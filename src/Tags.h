@@ -25,11 +25,15 @@ class HTMLParser;
 class HTMLTagHandler
 {
 public:
-	HTMLTagHandler(const char* inName) : name(inName) {}
+	HTMLTagHandler(const char* inName) : name(inName), index(++numTagHandlers) {}
 	virtual void Open(class HTMLParser& parser, char* attributeStr) const {}
 	virtual void Close(class HTMLParser& parser) const {}
 	
 	const char* name;
+	uint8_t index;			// Position in tagHandlers[] + 1 in construction order, used to count open elements per tag
+
+private:
+	static uint8_t numTagHandlers;
 };
 
 class SectionTagHandler : public HTMLTagHandler
@@ -223,4 +227,16 @@ public:
 
 const HTMLTagHandler* DetermineTag(const char* str);
 
+#ifdef MWBENCH
+struct TagLookupStats
+{
+	long lookups;
+	long comparisons;
+};
+
+extern TagLookupStats tagLookupStats;
+
+const char* FindUnhashedTag();
+#endif
+
 #endif
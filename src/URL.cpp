@@ -44,11 +44,23 @@ void URL::CleanUp()
 		}
 	}
 
-	// Fix &amp escape sequences
-	char* match;
-	while (match = strstr(url, "&amp;"))
+	// Fix &amp escape sequences in a single pass
+	char* writePtr = strstr(url, "&amp;");
+	if (writePtr)
 	{
-		memmove(match + 1, match + 5, strlen(match + 1) - 3);
+		for (const char* readPtr = writePtr; *readPtr; )
+		{
+			if (!strncmp(readPtr, "&amp;", 5))
+			{
+				*writePtr++ = '&';
+				readPtr += 5;
+			}
+			else
+			{
+				*writePtr++ = *readPtr++;
+			}
+		}
+		*writePtr = '\0';
 	}
 }
 